@@ -1,174 +1,1129 @@
-/*
-    * AVL Tree Implementation in C++
-    * This code implements an AVL tree with insertion functionality.
-    * It maintains the balance of the tree after each insertion. 
-*/
-
-
-#include <iostream>
-#include <algorithm>
-using namespace std;
-
-struct Node { // Structure for AVL Tree Node
-
-    // Each node contains a key, pointers to left and right children, height, and height difference
-    // The height is used to maintain the balance of the AVL tree
-    // The height difference is used to determine the type of rotation needed for balancing
-    // The key is the value stored in the node
-
-    int key;
-    Node *left, *right;
-    int height;
-    int height_dif;
-
-    //Add here additional variables or structures if needed for other operations
-
-    Node(int k) : key(k), left(nullptr), right(nullptr), height(1) {}
-};
-
-// Function to get the height of a node
-int height(Node *N) {
-    return N ? N->height : 0;
-}
-
-// Function to perform right rotation
-void rotationRight(Node *&node) {
-    Node *temp = node->left;
-    node->left = temp->right;
-    temp->right = node;
-    node->height = 1 + max(height(node->left), height(node->right));
-    temp->height = 1 + max(height(temp->left), height(temp->right));
-    node = temp;
-}
-
-// Function to perform left rotation
-void rotationLeft(Node *&node) {
-    Node *temp = node->right;
-    node->right = temp->left;
-    temp->left = node;
-    node->height = 1 + max(height(node->left), height(node->right));
-    temp->height = 1 + max(height(temp->left), height(temp->right));
-    node = temp;
-}
-
-void balance(Node *&node) {
-    /*
-        * This function checks the balance of the AVL tree and performs rotations if necessary.
-        * It is called after every insertion to ensure the tree remains balanced.
-    */
-    if (!node) return;
-
-    node->height = 1 + max(height(node->left), height(node->right));
-    node->height_dif = height(node->left) - height(node->right);
-
-    if (node->height_dif > 1) {
-        if (node->left->height_dif >= 0) {
-            rotationRight(node); // Left Left Case
-        } else {
-            rotationLeft(node->left); // Left Right Case
-            rotationRight(node); // After left rotation, perform right rotation
-        }
-    } else if (node->height_dif < -1) {
-        if (node->right->height_dif <= 0) {
-            rotationLeft(node); // Right Right Case
-        } else {
-            rotationRight(node->right); // Right Left Case
-            rotationLeft(node); // After right rotation, perform left rotation
-        }
-    }
-
-    node->height = 1 + max(height(node->left), height(node->right));
-    node->height_dif = height(node->left) - height(node->right);
-    
-}
-
-void insert(Node *&node, int key) {
-
-    /*
-        * This function inserts a new key into the AVL tree.
-        * It first finds the correct position for the new key,
-        * then updates the height and height difference of the nodes,
-        * and finally performs rotations to maintain the balance of the tree.
-    */
-
-    if (!node) {
-        node = new Node(key);
-        return;
-    }
-    if (key < node->key) {
-        insert(node->left, key);
-    } else if (key > node->key) {
-        insert(node->right, key);
-    } else {
-        return; // Duplicate keys are not allowed
-    }
-
-    balance(node); // Balance the tree after insertion
-
-}
-
-void del(Node *&node, int key) {
-    /*
-        * This function deletes a key from the AVL tree.
-        * It first finds the node to be deleted, then handles three cases:
-        * 1. Node with no child
-        * 2. Node with one child
-        * 3. Node with two children (in which case it finds the inorder successor)
-        * After deletion, it updates the height and height difference of the nodes,
-        * and performs rotations to maintain the balance of the tree.
-    */
-
-    if (!node) return;
-    if (key < node->key) {
-        del(node->left, key);
-    } else if (key > node->key) {
-        del(node->right, key);
-    } else {
-        // Node with only one child or no child
-        if (!node->left || !node->right) {
-            Node *temp = node->left ? node->left : node->right;
-            if (!temp) {
-                temp = node;
-                node = nullptr;
-            } else {
-                *node = *temp; // Copy the contents of the non-empty child
-            }
-            delete temp;
-        } else {
-            // Node with two children: Get the inorder successor (smallest in the right subtree)
-            Node *temp = node->right;
-            while (temp && temp->left) {
-                temp = temp->left;
-            }
-            node->key = temp->key; // Copy the inorder successor's content to this node
-            del(node->right, temp->key); // Delete the inorder successor
-        }
-    }
-
-    if (!node) return; // If the tree is empty after deletion
-    balance(node); // Balance the tree after deletion
-
-}
-
-/*
-To implement the AVL tree fully, you can add functions to search for a key,
-display the tree, and traverse it in different orders (inorder, preorder, postorder).
-The easiest way to search for a key it to use a binary search tree search algorithm.
-You can also add different variable or structures in the Node structures to store additional information
-like the number of nodes in the subtree, which can be useful for other operations.
-*/
-
-int main() {
-    Node *root = nullptr;
-    int keys[] = {10, 20, 30, 40, 50, 25};
-
-    for (int key : keys) {
-        insert(root, key);
-    }
-
-    cout << "AVL Tree constructed successfully." << endl;
-
-    // Additional code to display or manipulate the AVL tree can be added here.
-
-    return 0;
+/*
+    * AVL Tree Implementation in C++
+    * This code implements an AVL tree with insertion, deletion and search (find, contains, lowerBound).
+    * It maintains the balance of the tree after each update, and every node stores the size and the aggregate
+    * of its subtree for order statistics (getRank, select) and range queries (count, sum).
+    * It also has bulk construction, join/split set operations, a read-only FrozenAVL and a pooled AVLTree class.
+*/
+
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <new>
+#include <thread>
+#include <climits>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "../Instrumentation/Instrumentation.h"
+#include "../Trace/Trace.h"
+#include "../Benchmark/Benchmark.h"
+using namespace std;
+
+/*
+    * Aggregate kept in every node for the keys of its subtree, used by sum().
+    * It must be a monoid: combine is associative and identity is its neutral element.
+    * The default is the sum of the keys; replace the typedef to keep another aggregate,
+    * or use NoAggregate to keep only the subtree sizes with smaller nodes.
+*/
+struct SumAggregate {
+    typedef long long type;
+    static type identity(void) { return 0; }
+    static type lift(int key) { return key; }
+    static type combine(type a, type b) { return a + b; }
+};
+
+struct NoAggregate {
+    typedef char type;
+    static type identity(void) { return 0; }
+    static type lift(int) { return 0; }
+    static type combine(type, type) { return 0; }
+};
+
+typedef SumAggregate Aggregate;
+
+struct Node { // Structure for AVL Tree Node
+
+    // Each node contains a key, pointers to left and right children, height, and height difference
+    // The height is used to maintain the balance of the AVL tree
+    // The height difference is used to determine the type of rotation needed for balancing
+    // The key is the value stored in the node
+    // size (number of nodes) and agg (aggregate of the keys) describe the whole subtree,
+    // they are used for the order statistics and the range queries
+
+    int key;
+    Node *left, *right;
+    int height;
+    int height_dif;
+    int size;
+    Aggregate::type agg;
+
+    Node(int k) : key(k), left(nullptr), right(nullptr), height(1), height_dif(0), size(1), agg(Aggregate::lift(k)) {}
+};
+
+/*
+    * Allocators decide where the nodes of the tree live.
+    * Every allocator exposes the same three operations:
+    * - allocate(key) returns a new node containing key
+    * - deallocate(node) gives back a single node (used by del)
+    * - release(root) frees the whole tree and sets root to nullptr
+*/
+
+// Default allocator: one call to new/delete for every node
+struct NewDeleteAllocator {
+    Node *allocate(int key) {
+        TREE_COUNT("avl_node_allocations");
+        return new Node(key);
+    }
+
+    void deallocate(Node *node) {
+        delete node;
+    }
+
+    void release(Node *&node) {
+        if (!node) return;
+        release(node->left);
+        release(node->right);
+        delete node;
+        node = nullptr;
+    }
+};
+
+// Slab allocator: nodes are carved out of big contiguous blocks (slabs),
+// so nodes created together are close in memory.
+// Deleted nodes are kept in a free list (linked through their left pointer) and reused by the next allocation.
+// release() drops every slab at once, without visiting the nodes of the tree.
+class NodePool {
+    private:
+        vector <Node*> slabs;   // Blocks of raw memory, each one can contain slabSize nodes
+        size_t slabSize;    // Number of nodes in every slab
+        size_t used;    // Number of nodes already taken from the last slab
+        Node *freeList; // Head of the list of deleted nodes
+
+    public:
+        NodePool(size_t slabSize = 4096) : slabSize(slabSize), used(slabSize), freeList(nullptr) {}
+
+        NodePool(const NodePool&) = delete;
+        NodePool& operator=(const NodePool&) = delete;
+
+        ~NodePool() {
+            Node *root = nullptr;
+            release(root);
+        }
+
+        Node *allocate(int key) {
+            TREE_COUNT("avl_node_allocations");
+            Node *node;
+            if (freeList) {
+                TREE_COUNT("avl_pool_reused_nodes");
+                node = freeList; // Reuse the last deleted node
+                freeList = freeList->left;
+            } else {
+                if (used == slabSize) {
+                    TREE_COUNT("avl_pool_slabs");
+                    slabs.push_back(static_cast<Node*>(::operator new(slabSize * sizeof(Node))));
+                    used = 0;
+                }
+                node = slabs.back() + used++;
+            }
+            return new (node) Node(key);
+        }
+
+        void deallocate(Node *node) {
+            node->left = freeList;
+            freeList = node;
+        }
+
+        void release(Node *&root) {
+            for (Node *slab : slabs) {
+                ::operator delete(slab);
+            }
+            slabs.clear();
+            used = slabSize;
+            freeList = nullptr;
+            root = nullptr;
+        }
+
+        // Number of bytes reserved by the pool
+        size_t GetCapacity(void) {
+            return slabs.size() * slabSize * sizeof(Node);
+        }
+};
+
+NewDeleteAllocator defaultAllocator; // Allocator used by insert and del when no allocator is given
+
+// Function to get the height of a node
+int height(Node *N) {
+    return N ? N->height : 0;
+}
+
+// Function to get the number of nodes in a subtree
+int size(Node *N) {
+    return N ? N->size : 0;
+}
+
+// Function to get the aggregate of a subtree
+Aggregate::type agg(Node *N) {
+    return N ? N->agg : Aggregate::identity();
+}
+
+// Function to recompute the information of a node from its children
+void update(Node *node) {
+    node->height = 1 + max(height(node->left), height(node->right));
+    node->height_dif = height(node->left) - height(node->right);
+    node->size = 1 + size(node->left) + size(node->right);
+    node->agg = Aggregate::combine(Aggregate::combine(agg(node->left), Aggregate::lift(node->key)), agg(node->right));
+}
+
+// Function to perform right rotation
+void rotationRight(Node *&node) {
+    TREE_COUNT("avl_rotations");
+    Node *temp = node->left;
+    node->left = temp->right;
+    temp->right = node;
+    update(node);
+    update(temp);
+    node = temp;
+}
+
+// Function to perform left rotation
+void rotationLeft(Node *&node) {
+    TREE_COUNT("avl_rotations");
+    Node *temp = node->right;
+    node->right = temp->left;
+    temp->left = node;
+    update(node);
+    update(temp);
+    node = temp;
+}
+
+void balance(Node *&node) {
+    /*
+        * This function checks the balance of the AVL tree and performs rotations if necessary.
+        * It is called after every insertion to ensure the tree remains balanced.
+    */
+    if (!node) return;
+    TREE_COUNT("avl_balance_calls");
+
+    update(node);
+
+    if (node->height_dif > 1) {
+        if (node->left->height_dif >= 0) {
+            rotationRight(node); // Left Left Case
+        } else {
+            TREE_COUNT("avl_double_rotations");
+            rotationLeft(node->left); // Left Right Case
+            rotationRight(node); // After left rotation, perform right rotation
+        }
+    } else if (node->height_dif < -1) {
+        if (node->right->height_dif <= 0) {
+            rotationLeft(node); // Right Right Case
+        } else {
+            TREE_COUNT("avl_double_rotations");
+            rotationRight(node->right); // Right Left Case
+            rotationLeft(node); // After right rotation, perform left rotation
+        }
+    }
+
+    update(node);
+    
+}
+
+const int maxHeight = 64; // An AVL tree with this height contains more than 2^44 nodes
+
+// Function to walk back up a path of links (from the deepest one) after an insertion or a deletion.
+// Every node is balanced; as soon as a subtree keeps its old height the nodes above it can't rotate,
+// so for them only size and aggregate are updated.
+void retrace(Node ***path, int depth) {
+    while (depth > 0) {
+        Node *&node = *path[--depth];
+        int oldHeight = node->height;
+        balance(node);
+        if (node->height == oldHeight) break;
+    }
+    while (depth > 0) {
+        update(*path[--depth]);
+    }
+}
+
+template <class Alloc>
+void insert(Node *&node, int key, Alloc &alloc) {
+    TREE_RECORD(TRACE_INSERT, key);
+
+    /*
+        * This function inserts a new key into the AVL tree.
+        * It first finds the correct position for the new key, remembering the links it follows,
+        * then walks the same links back up updating the height and height difference of the nodes
+        * and performing rotations to maintain the balance of the tree.
+        * It is iterative, so the depth of the tree doesn't use stack frames.
+    */
+
+    Node **path[maxHeight];
+    int depth = 0;
+
+    Node **link = &node;
+    while (*link) {
+        Node *current = *link;
+        if (key == current->key) return; // Duplicate keys are not allowed
+        path[depth++] = link;
+        link = key < current->key ? &current->left : &current->right;
+    }
+
+    *link = alloc.allocate(key);
+    retrace(path, depth); // Balance the tree after insertion
+
+}
+
+template <class Alloc>
+void del(Node *&node, int key, Alloc &alloc) {
+    TREE_RECORD(TRACE_DELETE, key);
+    /*
+        * This function deletes a key from the AVL tree.
+        * It first finds the node to be deleted, then handles three cases:
+        * 1. Node with no child
+        * 2. Node with one child
+        * 3. Node with two children (in which case it finds the inorder successor)
+        * After deletion, it walks back up the path updating the height and height difference of the nodes,
+        * and performs rotations to maintain the balance of the tree.
+    */
+
+    Node **path[maxHeight];
+    int depth = 0;
+
+    Node **link = &node;
+    while (*link && (*link)->key != key) {
+        path[depth++] = link;
+        link = key < (*link)->key ? &(*link)->left : &(*link)->right;
+    }
+    if (!*link) return; // Key not found
+
+    Node *temp = *link;
+    if (!temp->left || !temp->right) {
+        // Node with only one child or no child: the child takes its place
+        *link = temp->left ? temp->left : temp->right;
+    } else {
+        // Node with two children: Get the inorder successor (smallest in the right subtree)
+        path[depth++] = link;
+        Node **successor = &temp->right;
+        while ((*successor)->left) {
+            path[depth++] = successor;
+            successor = &(*successor)->left;
+        }
+        temp->key = (*successor)->key; // Copy the inorder successor's content to this node
+        temp = *successor;
+        *successor = temp->right; // Delete the inorder successor
+    }
+    alloc.deallocate(temp);
+
+    retrace(path, depth); // Balance the tree after deletion
+
+}
+
+// insert and del without an explicit allocator use new and delete
+void insert(Node *&node, int key) {
+    insert(node, key, defaultAllocator);
+}
+
+void del(Node *&node, int key) {
+    del(node, key, defaultAllocator);
+}
+
+// Function to search a key, it returns the node containing key or nullptr
+Node *find(Node *node, int key) {
+    while (node && node->key != key) {
+        node = key < node->key ? node->left : node->right;
+    }
+    return node;
+}
+
+bool contains(Node *node, int key) {
+    TREE_RECORD(TRACE_FIND, key);
+    return find(node, key) != nullptr;
+}
+
+// Function to get the node with the smallest key greater or equal to key, or nullptr if there isn't one
+Node *lowerBound(Node *node, int key) {
+    Node *result = nullptr;
+    while (node) {
+        if (node->key >= key) {
+            result = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return result;
+}
+
+// Function to count the keys smaller than key
+int getRank(Node *node, int key) {
+    int result = 0;
+    while (node) {
+        if (node->key < key) {
+            result += size(node->left) + 1;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return result;
+}
+
+// Function to get the node with the k-th smallest key (k starts from 0), or nullptr if k is out of range
+Node *select(Node *node, int k) {
+    while (node) {
+        int leftSize = size(node->left);
+        if (k < leftSize) {
+            node = node->left;
+        } else if (k == leftSize) {
+            return node;
+        } else {
+            k -= leftSize + 1;
+            node = node->right;
+        }
+    }
+    return nullptr;
+}
+
+// Function to count the keys in [low, high]
+int count(Node *node, int low, int high) {
+    if (low > high) return 0;
+    int upTo = 0; // Number of keys smaller or equal to high
+    for (Node *current = node; current; ) {
+        if (current->key <= high) {
+            upTo += size(current->left) + 1;
+            current = current->right;
+        } else {
+            current = current->left;
+        }
+    }
+    return upTo - getRank(node, low);
+}
+
+// Function to get the aggregate (the sum by default) of the keys in [low, high].
+// The keys are combined in increasing order, so also non commutative aggregates are correct.
+Aggregate::type sum(Node *node, int low, int high) {
+    // Find the highest node inside the range: the range is split between its two subtrees
+    while (node && (node->key < low || node->key > high)) {
+        node = node->key < low ? node->right : node->left;
+    }
+    if (!node) return Aggregate::identity();
+
+    // Keys >= low in the left subtree, collected from the greatest
+    Aggregate::type left = Aggregate::identity();
+    for (Node *current = node->left; current; ) {
+        if (current->key >= low) {
+            left = Aggregate::combine(Aggregate::combine(Aggregate::lift(current->key), agg(current->right)), left);
+            current = current->left;
+        } else {
+            current = current->right;
+        }
+    }
+
+    // Keys <= high in the right subtree, collected from the smallest
+    Aggregate::type right = Aggregate::identity();
+    for (Node *current = node->right; current; ) {
+        if (current->key <= high) {
+            right = Aggregate::combine(right, Aggregate::combine(agg(current->left), Aggregate::lift(current->key)));
+            current = current->right;
+        } else {
+            current = current->left;
+        }
+    }
+
+    return Aggregate::combine(Aggregate::combine(left, Aggregate::lift(node->key)), right);
+}
+
+// Function to collect the keys of the tree in increasing order
+void inOrder(Node *node, vector <int> &keys) {
+    if (!node) return;
+    inOrder(node->left, keys);
+    keys.push_back(node->key);
+    inOrder(node->right, keys);
+}
+
+// Function to give back to the allocator every node of a subtree, one node at a time
+template <class Alloc>
+void clear(Node *&node, Alloc &alloc) {
+    if (!node) return;
+    clear(node->left, alloc);
+    clear(node->right, alloc);
+    alloc.deallocate(node);
+    node = nullptr;
+}
+
+template <class Alloc>
+Node *buildFromSorted(const vector <int> &keys, size_t start, size_t end, Alloc &alloc) {
+    if (start >= end) return nullptr;
+
+    size_t mid = start + (end - start) / 2;
+    Node *node = alloc.allocate(keys[mid]);
+    node->left = buildFromSorted(keys, start, mid, alloc);
+    node->right = buildFromSorted(keys, mid + 1, end, alloc);
+    balance(node); // Only updates height and height difference, the middle key keeps the tree balanced
+
+    return node;
+}
+
+template <class Alloc>
+void buildFromSorted(Node *&node, const vector <int> &keys, Alloc &alloc) {
+    /*
+        * This function builds a new AVL tree from keys in O(n), without rotations.
+        * The keys must be sorted in increasing order and without duplicates.
+        * The old content of node is freed.
+    */
+    clear(node, alloc);
+    node = buildFromSorted(keys, 0, keys.size(), alloc);
+}
+
+void join(Node *&node, Node *left, Node *mid, Node *right) {
+    /*
+        * This function joins two AVL trees and a middle node in a single AVL tree.
+        * Every key in left must be smaller than mid->key and every key in right must be greater.
+        * It walks down the spine of the taller tree until the heights are close,
+        * attaches the smaller tree there and balances the nodes on the way back up,
+        * so it costs O(|height(left) - height(right)| + 1).
+    */
+    if (height(left) > height(right) + 1) {
+        join(left->right, left->right, mid, right);
+        balance(left);
+        node = left;
+    } else if (height(right) > height(left) + 1) {
+        join(right->left, left, mid, right->left);
+        balance(right);
+        node = right;
+    } else {
+        mid->left = left;
+        mid->right = right;
+        balance(mid);
+        node = mid;
+    }
+}
+
+void split(Node *node, int key, Node *&left, Node *&right, Node *&found) {
+    /*
+        * This function splits an AVL tree in two AVL trees:
+        * left with the keys smaller than key and right with the keys greater than key.
+        * If key is in the tree its node is detached and returned in found, otherwise found is nullptr.
+        * It costs O(log n) because the joins on the way back up have telescoping costs.
+    */
+    if (!node) {
+        left = right = found = nullptr;
+        return;
+    }
+
+    Node *l = node->left, *r = node->right;
+    if (key < node->key) {
+        split(l, key, left, l, found);
+        join(right, l, node, r);
+    } else if (key > node->key) {
+        split(r, key, r, right, found);
+        join(left, l, node, r);
+    } else {
+        left = l;
+        right = r;
+        found = node;
+        found->left = found->right = nullptr;
+        balance(found);
+    }
+}
+
+// Function to detach the node with the greatest key from the tree
+void splitLast(Node *node, Node *&rest, Node *&last) {
+    if (!node->right) {
+        rest = node->left;
+        last = node;
+        return;
+    }
+
+    Node *r;
+    splitLast(node->right, r, last);
+    join(rest, node->left, node, r);
+}
+
+// Function to join two AVL trees without a middle node, every key in left must be smaller than the keys in right
+void join(Node *&node, Node *left, Node *right) {
+    if (!left) {
+        node = right;
+        return;
+    }
+
+    Node *rest, *last;
+    splitLast(left, rest, last);
+    join(node, rest, last, right);
+}
+
+/*
+    * Set operations between two trees built with the same allocator.
+    * They are divide and conquer algorithms: the root of a is used to split b,
+    * the two halves are solved recursively (in parallel near the top of the recursion)
+    * and the results are joined again. The cost is O(m log(n / m + 1)) with m <= n.
+    * The nodes removed from the result are collected in garbage and freed by the calling thread,
+    * so the allocator doesn't need to be thread safe.
+*/
+
+enum SetOperation { SET_UNION, SET_INTERSECTION, SET_DIFFERENCE };
+
+const int parallelHeight = 12; // Subtrees lower than this are always solved by a single thread
+
+Node *setOperation(SetOperation op, Node *a, Node *b, int depth, vector <Node*> &garbage) {
+    if (!a || !b) {
+        if (op == SET_UNION) return a ? a : b;
+        if (b) garbage.push_back(b); // Nothing of b survives an intersection or a difference
+        if (op == SET_INTERSECTION && a) garbage.push_back(a);
+        return op == SET_DIFFERENCE ? a : nullptr;
+    }
+
+    bool parallel = depth > 0 && max(height(a), height(b)) >= parallelHeight;
+
+    Node *bLeft, *bRight, *found;
+    split(b, a->key, bLeft, bRight, found);
+
+    Node *aLeft = a->left, *aRight = a->right;
+    Node *left, *right;
+    if (parallel) {
+        vector <Node*> leftGarbage;
+        thread worker([&]() {
+            left = setOperation(op, aLeft, bLeft, depth - 1, leftGarbage);
+        });
+        right = setOperation(op, aRight, bRight, depth - 1, garbage);
+        worker.join();
+        garbage.insert(garbage.end(), leftGarbage.begin(), leftGarbage.end());
+    } else {
+        left = setOperation(op, aLeft, bLeft, 0, garbage);
+        right = setOperation(op, aRight, bRight, 0, garbage);
+    }
+
+    bool keep = op == SET_UNION || (op == SET_INTERSECTION) == (found != nullptr); // Is a->key in the result?
+
+    Node *node;
+    if (keep) {
+        join(node, left, a, right); // The root of a is kept
+        if (found) garbage.push_back(found);
+    } else {
+        join(node, left, right); // The root of a is removed
+        a->left = a->right = nullptr;
+        garbage.push_back(a);
+        if (found) garbage.push_back(found);
+    }
+
+    return node;
+}
+
+template <class Alloc>
+void setOperation(SetOperation op, Node *&a, Node *&b, Alloc &alloc, int threads) {
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+    int depth = 0; // Number of recursion levels that start a new thread
+    while ((1 << depth) < threads) depth++;
+
+    vector <Node*> garbage;
+    a = setOperation(op, a, b, depth, garbage);
+    b = nullptr;
+    for (Node *node : garbage) {
+        clear(node, alloc);
+    }
+}
+
+// a becomes the union of a and b, b becomes empty
+template <class Alloc>
+void unionTrees(Node *&a, Node *&b, Alloc &alloc, int threads = 0) {
+    setOperation(SET_UNION, a, b, alloc, threads);
+}
+
+// a becomes the intersection of a and b, b becomes empty
+template <class Alloc>
+void intersectTrees(Node *&a, Node *&b, Alloc &alloc, int threads = 0) {
+    setOperation(SET_INTERSECTION, a, b, alloc, threads);
+}
+
+// a becomes the difference a - b, b becomes empty
+template <class Alloc>
+void differenceTrees(Node *&a, Node *&b, Alloc &alloc, int threads = 0) {
+    setOperation(SET_DIFFERENCE, a, b, alloc, threads);
+}
+
+/*
+    * FrozenAVL is an immutable copy of the keys of an AVL tree, made for read only lookups.
+    * The keys are stored in a static B-tree laid out in a single array (no pointers):
+    * every block holds 16 sorted keys (one 64 byte cache line) and the 17 children of block k
+    * are the blocks k * 17 + 1 ... k * 17 + 17, so a lookup loads one cache line per level
+    * instead of one node per level.
+    * Inside a block the keys are compared with SSE2 / AVX2 instructions when they are available.
+    * Unused slots of the last blocks contain INT_MAX.
+*/
+class FrozenAVL {
+    private:
+        static const int B = 16; // Keys per block
+
+        struct alignas(64) Block {
+            int keys[B];
+        };
+
+        vector <Block> blocks;
+        size_t count; // Number of keys
+        bool hasMax; // True if INT_MAX is a real key and not only padding
+
+        static size_t child(size_t k, int i) {
+            return k * (B + 1) + i + 1;
+        }
+
+        // Function to count the keys of a block smaller than key
+        static int rank(const Block &block, int key) {
+#if defined(__AVX2__)
+            __m256i x = _mm256_set1_epi32(key);
+            __m256i low = _mm256_load_si256(reinterpret_cast<const __m256i*>(block.keys));
+            __m256i high = _mm256_load_si256(reinterpret_cast<const __m256i*>(block.keys + 8));
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, low)))
+                     | _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, high))) << 8;
+            return __builtin_popcount(mask);
+#elif defined(__SSE2__)
+            __m128i x = _mm_set1_epi32(key);
+            int mask = 0;
+            for (int i = 0; i < B; i += 4) {
+                __m128i keys = _mm_load_si128(reinterpret_cast<const __m128i*>(block.keys + i));
+                mask |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(x, keys))) << i;
+            }
+            return __builtin_popcount(mask);
+#else
+            int result = 0;
+            for (int i = 0; i < B; i++) {
+                result += block.keys[i] < key;
+            }
+            return result;
+#endif
+        }
+
+        // Function to copy the sorted keys in the blocks, visiting the blocks in order
+        void fill(const vector <int> &keys, size_t k, size_t &next) {
+            if (k >= blocks.size()) return;
+            for (int i = 0; i < B; i++) {
+                fill(keys, child(k, i), next);
+                blocks[k].keys[i] = next < keys.size() ? keys[next++] : INT_MAX;
+            }
+            fill(keys, child(k, B), next);
+        }
+
+        // The last slot found is a real key unless it is padding
+        const int *result(const int *slot) const {
+            return slot && (*slot != INT_MAX || hasMax) ? slot : nullptr;
+        }
+
+    public:
+        FrozenAVL(void) : count(0), hasMax(false) {}
+
+        // Function to replace the content of the snapshot with the keys of the tree
+        void freeze(Node *root) {
+            vector <int> keys;
+            inOrder(root, keys);
+            count = keys.size();
+            hasMax = count > 0 && keys.back() == INT_MAX;
+            blocks.assign((count + B - 1) / B, Block());
+            size_t next = 0;
+            fill(keys, 0, next);
+        }
+
+        // Function to get a pointer to the smallest key greater or equal to key, or nullptr if there isn't one
+        const int *lowerBound(int key) const {
+            const int *slot = nullptr;
+            size_t k = 0;
+            while (k < blocks.size()) {
+                int i = rank(blocks[k], key);
+                if (i < B) slot = &blocks[k].keys[i];
+                k = child(k, i);
+            }
+            return result(slot);
+        }
+
+        bool contains(int key) const {
+            const int *slot = lowerBound(key);
+            return slot && *slot == key;
+        }
+
+        // Batched lowerBound: groups of queries go down the tree together one level at a time,
+        // and the block needed by every query at the next level is prefetched,
+        // so the cache misses of different queries overlap.
+        void lowerBound(const vector <int> &keys, vector <const int*> &results) const {
+            const size_t group = 32;
+            results.assign(keys.size(), nullptr);
+
+            for (size_t first = 0; first < keys.size(); first += group) {
+                size_t last = min(keys.size(), first + group);
+                size_t position[group];
+                fill_n(position, group, 0);
+
+                bool active = !blocks.empty();
+                while (active) {
+                    active = false;
+                    for (size_t q = first; q < last; q++) {
+                        size_t &k = position[q - first];
+                        if (k >= blocks.size()) continue;
+                        int i = rank(blocks[k], keys[q]);
+                        if (i < B) results[q] = &blocks[k].keys[i];
+                        k = child(k, i);
+                        if (k < blocks.size()) {
+                            __builtin_prefetch(&blocks[k]);
+                            active = true;
+                        }
+                    }
+                }
+
+                for (size_t q = first; q < last; q++) {
+                    results[q] = result(results[q]);
+                }
+            }
+        }
+
+        size_t size(void) const {
+            return count;
+        }
+};
+
+/*
+    * AVLTree keeps the root of the tree together with its allocator.
+    * The allocator is a template parameter (policy), so NodePool and NewDeleteAllocator
+    * can be used with the same code.
+    * The destructor frees the whole tree.
+    * freeze() returns a FrozenAVL snapshot of the keys, rebuilt only when the tree changed since the last call.
+*/
+template <class Alloc = NewDeleteAllocator>
+class AVLTree {
+    private:
+        Node *root;
+        Alloc alloc;
+        FrozenAVL frozen;
+        unsigned long long modifications; // Number of operations that changed the tree
+        unsigned long long frozenAt; // Value of modifications when frozen was built
+
+    public:
+        AVLTree(void) : root(nullptr), modifications(0), frozenAt(0) {}
+
+        AVLTree(const AVLTree&) = delete;
+        AVLTree& operator=(const AVLTree&) = delete;
+
+        ~AVLTree() {
+            clear();
+        }
+
+        void insert(int key) {
+            TREE_TIME("avl_insert");
+            ::insert(root, key, alloc);
+            modifications++;
+        }
+
+        void del(int key) {
+            TREE_TIME("avl_del");
+            ::del(root, key, alloc);
+            modifications++;
+        }
+
+        Node *find(int key) {
+            return ::find(root, key);
+        }
+
+        bool contains(int key) {
+            return ::contains(root, key);
+        }
+
+        Node *lowerBound(int key) {
+            return ::lowerBound(root, key);
+        }
+
+        int rank(int key) {
+            return ::getRank(root, key);
+        }
+
+        Node *select(int k) {
+            return ::select(root, k);
+        }
+
+        int count(int low, int high) {
+            return ::count(root, low, high);
+        }
+
+        Aggregate::type sum(int low, int high) {
+            return ::sum(root, low, high);
+        }
+
+        int size(void) {
+            return ::size(root);
+        }
+
+        // Replace the content of the tree with sorted keys in O(n)
+        void buildFromSorted(const vector <int> &keys) {
+            ::buildFromSorted(root, keys, alloc);
+            modifications++;
+        }
+
+        // Free every node of the tree
+        void clear(void) {
+            alloc.release(root);
+            modifications++;
+        }
+
+        const FrozenAVL &freeze(void) {
+            if (frozenAt != modifications) {
+                frozen.freeze(root);
+                frozenAt = modifications;
+            }
+            return frozen;
+        }
+
+        Node *&GetRoot(void) {
+            return root;
+        }
+
+        Alloc &GetAllocator(void) {
+            return alloc;
+        }
+};
+
+// Insert/delete churn used to compare the allocators:
+// n random inserts, n random deletes mixed with n new inserts, then the teardown of the whole tree
+template <class Alloc>
+void benchmarkAllocator(const char *name, int n) {
+    mt19937 rng(42);
+    uniform_int_distribution<int> dist(0, 4 * n);
+    vector <int> keys(n);
+    for (int &key : keys) key = dist(rng);
+
+    auto begin = chrono::steady_clock::now();
+    {
+        AVLTree<Alloc> tree;
+        for (int key : keys) tree.insert(key);
+        for (int i = 0; i < n; i++) {
+            tree.del(keys[i]);
+            tree.insert(dist(rng));
+        }
+    } // The destructor releases the tree
+    auto end = chrono::steady_clock::now();
+
+    double seconds = chrono::duration<double>(end - begin).count();
+    cout << name << ": " << 3 * n << " operations in " << seconds << " s ("
+         << (long long)(3 * n / seconds) << " ops/s)" << endl;
+}
+
+// Random lookups with contains and lowerBound on a tree of n keys
+void benchmarkLookup(int n) {
+    mt19937 rng(7);
+    uniform_int_distribution<int> dist(0, 4 * n);
+    AVLTree<NodePool> tree;
+    for (int i = 0; i < n; i++) tree.insert(dist(rng));
+
+    long long found = 0;
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        found += tree.contains(dist(rng));
+        Node *next = tree.lowerBound(dist(rng));
+        found += next ? next->key & 1 : 0;
+    }
+    auto end = chrono::steady_clock::now();
+
+    double seconds = chrono::duration<double>(end - begin).count();
+    cout << "lookups: " << 2 * n << " operations in " << seconds << " s ("
+         << (long long)(2 * n / seconds) << " ops/s, checksum " << found << ")" << endl;
+}
+
+// count and sum over random ranges: in-order traversal against the subtree sizes and aggregates
+void benchmarkRanges(int n, int queries) {
+    mt19937 rng(13);
+    uniform_int_distribution<int> dist(0, 4 * n);
+    AVLTree<NodePool> tree;
+    for (int i = 0; i < n; i++) tree.insert(dist(rng));
+
+    vector <pair <int, int>> ranges(queries);
+    for (auto &range : ranges) {
+        range.first = dist(rng);
+        range.second = range.first + dist(rng) / 4;
+    }
+
+    long long checksum = 0;
+    auto begin = chrono::steady_clock::now();
+    for (auto &range : ranges) {
+        vector <int> keys;
+        inOrder(tree.GetRoot(), keys);
+        for (int key : keys) {
+            if (key >= range.first && key <= range.second) checksum += 1 + key;
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    cout << "in-order count + sum: " << chrono::duration<double>(end - begin).count() << " s (checksum " << checksum << ")" << endl;
+
+    checksum = 0;
+    begin = chrono::steady_clock::now();
+    for (auto &range : ranges) {
+        checksum += tree.count(range.first, range.second) + tree.sum(range.first, range.second);
+    }
+    end = chrono::steady_clock::now();
+    cout << "augmented count + sum: " << chrono::duration<double>(end - begin).count() << " s (checksum " << checksum << ")" << endl;
+}
+
+// lowerBound on the pointer tree against the frozen snapshot, one query at a time and batched
+void benchmarkFrozen(int n) {
+    mt19937 rng(11);
+    uniform_int_distribution<int> dist(0, 4 * n);
+    AVLTree<NodePool> tree;
+    for (int i = 0; i < n; i++) tree.insert(dist(rng));
+    vector <int> queries(n);
+    for (int &query : queries) query = dist(rng);
+
+    auto begin = chrono::steady_clock::now();
+    const FrozenAVL &frozen = tree.freeze();
+    auto end = chrono::steady_clock::now();
+    cout << "freeze: " << chrono::duration<double>(end - begin).count() << " s" << endl;
+
+    long long checksum = 0;
+    begin = chrono::steady_clock::now();
+    for (int query : queries) {
+        Node *next = tree.lowerBound(query);
+        checksum += next ? next->key : -1;
+    }
+    end = chrono::steady_clock::now();
+    cout << "pointer lowerBound: " << chrono::duration<double>(end - begin).count() << " s (checksum " << checksum << ")" << endl;
+
+    checksum = 0;
+    begin = chrono::steady_clock::now();
+    for (int query : queries) {
+        const int *next = frozen.lowerBound(query);
+        checksum += next ? *next : -1;
+    }
+    end = chrono::steady_clock::now();
+    cout << "frozen lowerBound: " << chrono::duration<double>(end - begin).count() << " s (checksum " << checksum << ")" << endl;
+
+    checksum = 0;
+    vector <const int*> results;
+    begin = chrono::steady_clock::now();
+    frozen.lowerBound(queries, results);
+    for (const int *next : results) checksum += next ? *next : -1;
+    end = chrono::steady_clock::now();
+    cout << "frozen batched lowerBound: " << chrono::duration<double>(end - begin).count() << " s (checksum " << checksum << ")" << endl;
+}
+
+// Bulk load and merge of two key sets: insert loop against buildFromSorted + unionTrees
+void benchmarkBulk(int n, int threads) {
+    vector <int> a(n), b(n);
+    for (int i = 0; i < n; i++) {
+        a[i] = 2 * i; // Even keys
+        b[i] = 3 * i; // Multiples of 3, so half of them are also in a
+    }
+
+    NodePool pool;
+    Node *x = nullptr, *y = nullptr;
+    auto begin = chrono::steady_clock::now();
+    for (int key : a) insert(x, key, pool);
+    for (int key : b) insert(x, key, pool);
+    auto end = chrono::steady_clock::now();
+    cout << "insert loop: " << chrono::duration<double>(end - begin).count() << " s" << endl;
+    pool.release(x);
+
+    begin = chrono::steady_clock::now();
+    buildFromSorted(x, a, pool);
+    buildFromSorted(y, b, pool);
+    end = chrono::steady_clock::now();
+    cout << "buildFromSorted: " << chrono::duration<double>(end - begin).count() << " s" << endl;
+
+    begin = chrono::steady_clock::now();
+    unionTrees(x, y, pool, threads);
+    end = chrono::steady_clock::now();
+    cout << "unionTrees (" << threads << " threads): " << chrono::duration<double>(end - begin).count() << " s" << endl;
+}
+
+// Workload of the shared suite: n keys of [0, 4n), the queries are contains and the updates insert and delete keys
+void suiteWorkload(const Workload &workload) {
+    uint64_t n = workload.size;
+    KeyGenerator keys(workload.distribution, 4 * n, workload.seed());
+    BenchmarkRun run("avl", workload);
+
+    run.startBuild();
+    AVLTree<NodePool> tree;
+    for (uint64_t i = 0; i < n; i++) tree.insert((int)keys.next());
+    run.endBuild(tree.size());
+
+    bool erase = false;
+    run.run(4 * n, [&](bool read, uint64_t key, uint64_t) -> long long {
+        if (read) return tree.contains((int)key);
+        erase = !erase; // Half of the updates delete, so the size stays about the same
+        if (erase) tree.del((int)key);
+        else tree.insert((int)key);
+        return 0;
+    });
+}
+
+// Replay the inserts, deletes and lookups of a trace on an AVLTree with the allocator Alloc
+template <class Alloc>
+bool replay(const string &path, const string &backend) {
+    AVLTree<Alloc> tree;
+    return replayTrace(path, backend, [&](const TraceRecord &record) -> long long {
+        int key = (int)record.arguments[0];
+        switch (record.operation) {
+            case TRACE_INSERT: tree.insert(key); return 0;
+            case TRACE_DELETE: tree.del(key); return 0;
+            case TRACE_FIND: return tree.contains(key);
+            default: throw unsupported(record);
+        }
+    });
+}
+
+/*
+Search, the size and the aggregate of the subtrees are implemented above.
+To display the tree you can still add the preorder and postorder traversals next to inOrder.
+*/
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        int n = argc > 2 ? stoi(argv[2]) : 1000000;
+        benchmarkAllocator<NewDeleteAllocator>("new/delete", n);
+        benchmarkAllocator<NodePool>("NodePool", n);
+        benchmarkLookup(n);
+        benchmarkFrozen(n);
+        benchmarkRanges(n, 100);
+        benchmarkBulk(n, 1);
+        benchmarkBulk(n, max(1u, thread::hardware_concurrency()));
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "suite") {
+        // ./AVL_tree suite [sizes...], one JSON line for every workload
+        return runSuite("avl", suiteSizes(argc, argv, 2), suiteWorkload) ? 0 : 1;
+    }
+    if (argc > 2 && string(argv[1]) == "replay") {
+        // ./AVL_tree replay <trace> [NodePool | new/delete], by default both
+        string backend = argc > 3 ? argv[3] : "";
+        bool passed = true;
+        if (backend.empty() || backend == "NodePool") passed = replay<NodePool>(argv[2], "NodePool") && passed;
+        if (backend.empty() || backend == "new/delete") passed = replay<NewDeleteAllocator>(argv[2], "new/delete") && passed;
+        return passed ? 0 : 1;
+    }
+
+    Node *root = nullptr;
+    int keys[] = {10, 20, 30, 40, 50, 25};
+
+    for (int key : keys) {
+        insert(root, key);
+    }
+
+    cout << "AVL Tree constructed successfully." << endl;
+
+    // Additional code to display or manipulate the AVL tree can be added here.
+
+    Node *other = nullptr;
+    buildFromSorted(other, vector <int>{5, 25, 35, 50}, defaultAllocator);
+    unionTrees(root, other, defaultAllocator);
+
+    vector <int> merged;
+    inOrder(root, merged);
+    cout << "Union with {5, 25, 35, 50}:";
+    for (int key : merged) cout << " " << key;
+    cout << endl;
+
+    cout << "Rank of 30: " << getRank(root, 30) << ", third key: " << select(root, 2)->key
+         << ", keys in [20, 40]: " << count(root, 20, 40) << ", sum of [20, 40]: " << sum(root, 20, 40) << endl;
+
+    defaultAllocator.release(root); // Free the tree
+
+    TREE_STATS_DUMP(cout); // Counters of the example, only with -DTREE_STATS
+
+    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,450 @@
+/*
+    * Compact AVL Tree Implementation in C++
+    * This code implements a generic AVL tree with small nodes.
+    * The nodes are stored in a contiguous vector and they point to their children
+    * with 32 bit indices instead of 64 bit pointers.
+    * Instead of the height, every node keeps only its balance factor (-1, 0, +1) in 2 bits.
+    * The rotations and the deletion (with the inorder successor) are the same of AVL_tree.cpp.
+*/
+
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+using namespace std;
+
+template <class Key, class Compare = less<Key>, class Alloc = allocator<Key>>
+class AVLTree {
+    private:
+        struct Node { // Structure for AVL Tree Node
+
+            // left and right are positions in the nodes vector, 0 means no child.
+            // The 2 highest bits of right contain the balance factor (height of left - height of right) + 1,
+            // the other 30 bits contain the position of the right child.
+
+            Key key;
+            uint32_t left;
+            uint32_t right;
+        };
+
+        static const uint32_t NIL = 0; // nodes[0] is never used, so 0 can mean "no node"
+        static const uint32_t indexMask = (1u << 30) - 1;
+
+        typedef typename allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+
+        vector <Node, NodeAlloc> nodes;
+        uint32_t root;
+        uint32_t freeList; // Deleted nodes, linked through left
+        size_t count; // Number of keys
+        Compare comp;
+
+        uint32_t &left(uint32_t node) {
+            return nodes[node].left;
+        }
+
+        uint32_t right(uint32_t node) const {
+            return nodes[node].right & indexMask;
+        }
+
+        void setRight(uint32_t node, uint32_t child) {
+            nodes[node].right = (nodes[node].right & ~indexMask) | child;
+        }
+
+        int balanceOf(uint32_t node) const {
+            return (int)(nodes[node].right >> 30) - 1;
+        }
+
+        void setBalance(uint32_t node, int balance) {
+            nodes[node].right = (nodes[node].right & indexMask) | (uint32_t)(balance + 1) << 30;
+        }
+
+        uint32_t allocate(const Key &key) {
+            uint32_t node;
+            if (freeList != NIL) {
+                node = freeList;
+                freeList = nodes[node].left;
+                nodes[node].key = key;
+            } else {
+                if (nodes.size() > indexMask) throw length_error("Too many nodes");
+                node = nodes.size();
+                nodes.push_back(Node{key, NIL, NIL});
+            }
+            nodes[node].left = NIL;
+            nodes[node].right = NIL;
+            setBalance(node, 0);
+            return node;
+        }
+
+        void deallocate(uint32_t node) {
+            nodes[node].left = freeList;
+            freeList = node;
+        }
+
+        // Function to perform right rotation
+        void rotationRight(uint32_t &node) {
+            uint32_t temp = left(node);
+            left(node) = right(temp);
+            setRight(temp, node);
+            node = temp;
+        }
+
+        // Function to perform left rotation
+        void rotationLeft(uint32_t &node) {
+            uint32_t temp = right(node);
+            setRight(node, left(temp));
+            left(temp) = node;
+            node = temp;
+        }
+
+        // Balance factors of the two nodes moved by a double rotation, from the balance factor of the new root
+        void doubleRotationBalance(uint32_t first, uint32_t second, int middle) {
+            setBalance(first, middle == -1 ? 1 : 0);
+            setBalance(second, middle == 1 ? -1 : 0);
+        }
+
+        /*
+            * These functions fix a node whose balance factor would become +2 (fixLeft) or -2 (fixRight).
+            * They are the same cases of balance() in AVL_tree.cpp, but the new balance factors
+            * are computed from the old ones instead of from the heights.
+            * They return true if the height of the subtree decreased.
+        */
+        bool fixLeft(uint32_t &node) {
+            uint32_t child = left(node);
+            int childBalance = balanceOf(child);
+            if (childBalance >= 0) {
+                rotationRight(node); // Left Left Case
+                setBalance(node, childBalance == 0 ? -1 : 0);
+                setBalance(right(node), childBalance == 0 ? 1 : 0);
+                return childBalance != 0;
+            }
+            int middle = balanceOf(right(child));
+            rotationLeft(left(node)); // Left Right Case
+            rotationRight(node);
+            doubleRotationBalance(left(node), right(node), middle);
+            setBalance(node, 0);
+            return true;
+        }
+
+        bool fixRight(uint32_t &node) {
+            uint32_t child = right(node);
+            int childBalance = balanceOf(child);
+            if (childBalance <= 0) {
+                rotationLeft(node); // Right Right Case
+                setBalance(node, childBalance == 0 ? 1 : 0);
+                setBalance(left(node), childBalance == 0 ? -1 : 0);
+                return childBalance != 0;
+            }
+            int middle = balanceOf(left(child));
+            uint32_t temp = right(node);
+            rotationRight(temp); // Right Left Case
+            setRight(node, temp);
+            rotationLeft(node);
+            doubleRotationBalance(left(node), right(node), middle);
+            setBalance(node, 0);
+            return true;
+        }
+
+        // Functions called when a subtree of node became one level taller, they return true if node became taller
+        bool leftGrew(uint32_t &node) {
+            int balance = balanceOf(node);
+            if (balance == 1) {
+                fixLeft(node);
+                return false;
+            }
+            setBalance(node, balance + 1);
+            return balance == 0;
+        }
+
+        bool rightGrew(uint32_t &node) {
+            int balance = balanceOf(node);
+            if (balance == -1) {
+                fixRight(node);
+                return false;
+            }
+            setBalance(node, balance - 1);
+            return balance == 0;
+        }
+
+        // Functions called when a subtree of node became one level shorter, they return true if node became shorter
+        bool leftShrank(uint32_t &node) {
+            int balance = balanceOf(node);
+            if (balance == -1) return fixRight(node);
+            setBalance(node, balance - 1);
+            return balance == 1;
+        }
+
+        bool rightShrank(uint32_t &node) {
+            int balance = balanceOf(node);
+            if (balance == 1) return fixLeft(node);
+            setBalance(node, balance + 1);
+            return balance == -1;
+        }
+
+        // Returns true if the height of the subtree increased, inserted is set if the key was not in the tree
+        bool insert(uint32_t &node, const Key &key, bool &inserted) {
+            if (node == NIL) {
+                node = allocate(key);
+                inserted = true;
+                return true;
+            }
+            if (comp(key, nodes[node].key)) {
+                uint32_t child = left(node);
+                bool grew = insert(child, key, inserted);
+                left(node) = child;
+                return grew && leftGrew(node);
+            }
+            if (comp(nodes[node].key, key)) {
+                uint32_t child = right(node);
+                bool grew = insert(child, key, inserted);
+                setRight(node, child);
+                return grew && rightGrew(node);
+            }
+            return false; // Duplicate keys are not allowed
+        }
+
+        // Function to remove the smallest node of a subtree, its key is copied in key
+        bool removeMin(uint32_t &node, Key &key) {
+            if (left(node) == NIL) {
+                key = nodes[node].key;
+                uint32_t temp = node;
+                node = right(node);
+                deallocate(temp);
+                return true;
+            }
+            uint32_t child = left(node);
+            bool shrank = removeMin(child, key);
+            left(node) = child;
+            return shrank && leftShrank(node);
+        }
+
+        // Returns true if the height of the subtree decreased, erased is set if the key was found
+        bool del(uint32_t &node, const Key &key, bool &erased) {
+            if (node == NIL) return false;
+
+            if (comp(key, nodes[node].key)) {
+                uint32_t child = left(node);
+                bool shrank = del(child, key, erased);
+                left(node) = child;
+                return shrank && leftShrank(node);
+            }
+            if (comp(nodes[node].key, key)) {
+                uint32_t child = right(node);
+                bool shrank = del(child, key, erased);
+                setRight(node, child);
+                return shrank && rightShrank(node);
+            }
+
+            erased = true;
+            if (left(node) == NIL || right(node) == NIL) {
+                // Node with only one child or no child
+                uint32_t temp = node;
+                node = left(node) != NIL ? left(node) : right(node);
+                deallocate(temp);
+                return true;
+            }
+
+            // Node with two children: copy the inorder successor and delete it from the right subtree
+            uint32_t child = right(node);
+            bool shrank = removeMin(child, nodes[node].key);
+            setRight(node, child);
+            return shrank && rightShrank(node);
+        }
+
+        void inOrder(uint32_t node, vector <Key> &keys) const {
+            if (node == NIL) return;
+            inOrder(nodes[node].left, keys);
+            keys.push_back(nodes[node].key);
+            inOrder(right(node), keys);
+        }
+
+        // Function to verify order and balance factors, it returns the height of the subtree or -1
+        int check(uint32_t node) const {
+            if (node == NIL) return 0;
+            int l = check(nodes[node].left), r = check(right(node));
+            if (l < 0 || r < 0 || l - r != balanceOf(node)) return -1;
+            if (nodes[node].left != NIL && !comp(nodes[nodes[node].left].key, nodes[node].key)) return -1;
+            if (right(node) != NIL && !comp(nodes[node].key, nodes[right(node)].key)) return -1;
+            return 1 + max(l, r);
+        }
+
+    public:
+        AVLTree(const Compare &comp = Compare(), const Alloc &alloc = Alloc())
+            : nodes(1, Node(), NodeAlloc(alloc)), root(NIL), freeList(NIL), count(0), comp(comp) {}
+
+        // Returns false if key was already in the tree
+        bool insert(const Key &key) {
+            bool inserted = false;
+            insert(root, key, inserted);
+            count += inserted;
+            return inserted;
+        }
+
+        // Returns false if key was not in the tree
+        bool del(const Key &key) {
+            bool erased = false;
+            del(root, key, erased);
+            count -= erased;
+            return erased;
+        }
+
+        bool contains(const Key &key) const {
+            return find(key) != nullptr;
+        }
+
+        // Function to search a key, it returns a pointer to the stored key or nullptr
+        const Key *find(const Key &key) const {
+            uint32_t node = root;
+            while (node != NIL) {
+                const Node &current = nodes[node];
+                if (comp(key, current.key)) {
+                    node = current.left;
+                } else if (comp(current.key, key)) {
+                    node = current.right & indexMask;
+                } else {
+                    return &current.key;
+                }
+            }
+            return nullptr;
+        }
+
+        // Function to get the smallest key greater or equal to key, or nullptr if there isn't one
+        const Key *lowerBound(const Key &key) const {
+            const Key *result = nullptr;
+            uint32_t node = root;
+            while (node != NIL) {
+                const Node &current = nodes[node];
+                if (!comp(current.key, key)) {
+                    result = &current.key;
+                    node = current.left;
+                } else {
+                    node = current.right & indexMask;
+                }
+            }
+            return result;
+        }
+
+        vector <Key> keys(void) const {
+            vector <Key> result;
+            result.reserve(count);
+            inOrder(root, result);
+            return result;
+        }
+
+        // Reserve space for n nodes, so the vector is not reallocated while the tree grows
+        void reserve(size_t n) {
+            nodes.reserve(n + 1);
+        }
+
+        void clear(void) {
+            nodes.resize(1);
+            root = freeList = NIL;
+            count = 0;
+        }
+
+        size_t size(void) const {
+            return count;
+        }
+
+        // Bytes reserved for the nodes
+        size_t memoryUsage(void) const {
+            return nodes.capacity() * sizeof(Node);
+        }
+
+        static size_t nodeSize(void) {
+            return sizeof(Node);
+        }
+
+        bool isValid(void) const {
+            return check(root) >= 0;
+        }
+};
+
+/*
+    * StringPrefix is a key made of the first 8 bytes of a string.
+    * The bytes are stored big endian in a 64 bit integer,
+    * so comparing the integers gives the same order as comparing the prefixes.
+*/
+struct StringPrefix {
+    uint64_t bits;
+
+    StringPrefix(void) : bits(0) {}
+
+    StringPrefix(const string &text) : bits(0) {
+        for (size_t i = 0; i < 8; i++) {
+            bits = bits << 8 | (i < text.size() ? (unsigned char)text[i] : 0);
+        }
+    }
+
+    string str(void) const {
+        string text;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            char c = (char)(bits >> shift & 0xFF);
+            if (c == 0) break;
+            text += c;
+        }
+        return text;
+    }
+
+    bool operator<(const StringPrefix &other) const {
+        return bits < other.bits;
+    }
+};
+
+// Memory and speed with n random 64 bit keys, followed by n random deletions
+void benchmarkCompact(int n) {
+    mt19937_64 rng(42);
+    vector <uint64_t> keys(n);
+    for (uint64_t &key : keys) key = rng();
+
+    AVLTree<uint64_t> tree;
+    auto begin = chrono::steady_clock::now();
+    for (uint64_t key : keys) tree.insert(key);
+    auto end = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(end - begin).count();
+
+    // Node of AVL_tree.cpp with a 64 bit key: key, two pointers and two ints
+    size_t pointerNode = sizeof(uint64_t) + 2 * sizeof(void*) + 2 * sizeof(int);
+    cout << "insert: " << (long long)(n / seconds) << " ops/s" << endl;
+    cout << "node size: " << AVLTree<uint64_t>::nodeSize() << " bytes (pointer node: " << pointerNode << " bytes + allocator overhead)" << endl;
+    cout << "memory per key: " << (double)tree.memoryUsage() / tree.size() << " bytes" << endl;
+
+    begin = chrono::steady_clock::now();
+    for (uint64_t key : keys) tree.del(key);
+    end = chrono::steady_clock::now();
+    seconds = chrono::duration<double>(end - begin).count();
+    cout << "del: " << (long long)(n / seconds) << " ops/s" << endl;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        benchmarkCompact(argc > 2 ? stoi(argv[2]) : 1000000);
+        return 0;
+    }
+
+    AVLTree<uint64_t> numbers;
+    uint64_t keys[] = {10, 20, 30, 40, 50, 25};
+    for (uint64_t key : keys) {
+        numbers.insert(key);
+    }
+    numbers.del(30);
+    cout << "Compact AVL Tree constructed successfully, keys:";
+    for (uint64_t key : numbers.keys()) cout << " " << key;
+    cout << endl;
+
+    AVLTree<StringPrefix> words;
+    string texts[] = {"orange", "apple", "banana", "apricots", "cherry"};
+    for (const string &text : texts) {
+        words.insert(StringPrefix(text));
+    }
+    const StringPrefix *next = words.lowerBound(StringPrefix("b"));
+    cout << "First prefix after \"b\": " << (next ? next->str() : "none") << endl;
+
+    return 0;
+}
@@ -0,0 +1,490 @@
+/*
+    * Concurrent AVL Tree Implementation in C++
+    * This code implements an AVL tree that can be used by many threads at the same time.
+    * Readers never block: they read an immutable version of the tree (RCU style).
+    * Writers copy only the nodes on the path they change (and the nodes they rotate),
+    * then publish the new root with a single atomic store.
+    * Old nodes are freed with epoch based reclamation, when no reader can still see them.
+*/
+
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+using namespace std;
+
+class ConcurrentAVL {
+    private:
+        struct Node { // Structure for AVL Tree Node
+
+            // Once a node is reachable from the published root it is never modified again.
+            // stamp is the number of the write that created the node: a writer can modify in place
+            // only the nodes created by itself, every other node is copied first.
+
+            int key;
+            Node *left, *right;
+            int height;
+            unsigned long long stamp;
+
+            Node(int k, unsigned long long s) : key(k), left(nullptr), right(nullptr), height(1), stamp(s) {}
+        };
+
+        /*
+            * Epoch based reclamation.
+            * Every reader thread owns a slot where it announces the global epoch while it is reading.
+            * A node removed from the tree at epoch e is freed only when every busy slot announces an epoch greater than e,
+            * because those readers started after the node was unlinked.
+        */
+        static const int maxReaders = 256; // Maximum number of threads reading at the same time
+
+        struct alignas(64) Slot {
+            atomic <unsigned long long> epoch; // 0 means that the thread is not reading
+            atomic <bool> used; // True if the slot belongs to a thread
+        };
+
+        static Slot slots[maxReaders];
+
+        // Every thread takes a slot the first time it reads and gives it back when it ends
+        struct SlotOwner {
+            int index;
+
+            SlotOwner(void) : index(-1) {
+                for (int i = 0; i < maxReaders; i++) {
+                    bool expected = false;
+                    if (!slots[i].used.load(memory_order_relaxed) && slots[i].used.compare_exchange_strong(expected, true)) {
+                        index = i;
+                        return;
+                    }
+                }
+                throw runtime_error("Too many reader threads");
+            }
+
+            ~SlotOwner() {
+                slots[index].epoch.store(0);
+                slots[index].used.store(false);
+            }
+        };
+
+        static Slot &mySlot(void) {
+            thread_local SlotOwner owner;
+            return slots[owner.index];
+        }
+
+        // A reader is inside the guard while it walks the tree
+        class ReadGuard {
+            private:
+                Slot &slot;
+            public:
+                ReadGuard(void) : slot(mySlot()) {
+                    slot.epoch.store(epoch.load());
+                }
+                ~ReadGuard() {
+                    slot.epoch.store(0, memory_order_release);
+                }
+        };
+
+        static atomic <unsigned long long> epoch; // Shared by all the trees, like the slots
+
+        atomic <Node*> root; // Published version of the tree
+        atomic <size_t> count; // Number of keys in the published version
+        mutex writer; // Writers are serialized, readers never take it
+
+        // State of the write in progress, protected by writer
+        unsigned long long stamp;
+        vector <Node*> replaced; // Published nodes copied by the current write
+        vector <pair <unsigned long long, Node*>> retired; // Nodes waiting to be freed, with the epoch of their removal
+
+        static int height(Node *node) {
+            return node ? node->height : 0;
+        }
+
+        static void update(Node *node) {
+            node->height = 1 + max(height(node->left), height(node->right));
+        }
+
+        // Function to get a node that the current write can modify: the node itself if it was created by this write, otherwise a copy
+        Node *own(Node *node) {
+            if (node->stamp == stamp) return node;
+            Node *copy = new Node(*node);
+            copy->stamp = stamp;
+            replaced.push_back(node);
+            return copy;
+        }
+
+        // Function to perform right rotation, node must be owned
+        void rotationRight(Node *&node) {
+            Node *temp = own(node->left);
+            node->left = temp->right;
+            temp->right = node;
+            update(node);
+            update(temp);
+            node = temp;
+        }
+
+        // Function to perform left rotation, node must be owned
+        void rotationLeft(Node *&node) {
+            Node *temp = own(node->right);
+            node->right = temp->left;
+            temp->left = node;
+            update(node);
+            update(temp);
+            node = temp;
+        }
+
+        // Same cases of the sequential balance, only the rotated nodes are copied
+        void balance(Node *&node) {
+            update(node);
+            int height_dif = height(node->left) - height(node->right);
+
+            if (height_dif > 1) {
+                if (height(node->left->left) >= height(node->left->right)) {
+                    rotationRight(node); // Left Left Case
+                } else {
+                    node->left = own(node->left);
+                    rotationLeft(node->left); // Left Right Case
+                    rotationRight(node);
+                }
+            } else if (height_dif < -1) {
+                if (height(node->right->right) >= height(node->right->left)) {
+                    rotationLeft(node); // Right Right Case
+                } else {
+                    node->right = own(node->right);
+                    rotationRight(node->right); // Right Left Case
+                    rotationLeft(node);
+                }
+            }
+        }
+
+        // Returns false if key was already in the tree, in this case nothing is copied
+        bool insert(Node *&node, int key) {
+            if (!node) {
+                node = new Node(key, stamp);
+                return true;
+            }
+            if (key == node->key) return false; // Duplicate keys are not allowed
+
+            Node *child = key < node->key ? node->left : node->right;
+            if (!insert(child, key)) return false;
+
+            node = own(node);
+            (key < node->key ? node->left : node->right) = child;
+            balance(node);
+            return true;
+        }
+
+        // Function to detach the smallest node of a subtree, returning its key
+        int removeMin(Node *&node) {
+            if (!node->left) {
+                int key = node->key;
+                replaced.push_back(node);
+                node = node->right;
+                return key;
+            }
+            node = own(node);
+            int key = removeMin(node->left);
+            balance(node);
+            return key;
+        }
+
+        // Returns false if key is not in the tree
+        bool del(Node *&node, int key) {
+            if (!node) return false;
+
+            if (key != node->key) {
+                Node *child = key < node->key ? node->left : node->right;
+                if (!del(child, key)) return false;
+                node = own(node);
+                (key < node->key ? node->left : node->right) = child;
+            } else if (!node->left || !node->right) {
+                // Node with only one child or no child
+                replaced.push_back(node);
+                node = node->left ? node->left : node->right;
+                return true;
+            } else {
+                // Node with two children: the inorder successor takes its key
+                node = own(node);
+                node->key = removeMin(node->right);
+            }
+
+            balance(node);
+            return true;
+        }
+
+        // Function to publish the result of a write and free the nodes no reader can see anymore
+        void publish(Node *newRoot) {
+            root.store(newRoot);
+            unsigned long long now = epoch.fetch_add(1);
+            for (Node *node : replaced) {
+                if (node->stamp == stamp) {
+                    delete node; // Created and dropped by this write, no reader has seen it
+                } else {
+                    retired.push_back(make_pair(now, node));
+                }
+            }
+            replaced.clear();
+
+            if (retired.size() >= 1024) reclaim();
+        }
+
+        void reclaim(void) {
+            unsigned long long oldest = epoch.load();
+            for (int i = 0; i < maxReaders; i++) {
+                unsigned long long announced = slots[i].epoch.load();
+                if (announced != 0) oldest = min(oldest, announced);
+            }
+
+            size_t kept = 0;
+            for (size_t i = 0; i < retired.size(); i++) {
+                if (retired[i].first < oldest) {
+                    delete retired[i].second;
+                } else {
+                    retired[kept++] = retired[i];
+                }
+            }
+            retired.resize(kept);
+        }
+
+        static void clear(Node *node) {
+            if (!node) return;
+            clear(node->left);
+            clear(node->right);
+            delete node;
+        }
+
+        // Function to verify order and balance of a subtree, returning its height (or -1)
+        static int check(Node *node, long long low, long long high) {
+            if (!node) return 0;
+            if (node->key <= low || node->key >= high) return -1;
+            int left = check(node->left, low, node->key);
+            int right = check(node->right, node->key, high);
+            if (left < 0 || right < 0 || abs(left - right) > 1 || node->height != 1 + max(left, right)) return -1;
+            return node->height;
+        }
+
+    public:
+        ConcurrentAVL(void) : root(nullptr), count(0), stamp(0) {}
+
+        ConcurrentAVL(const ConcurrentAVL&) = delete;
+        ConcurrentAVL& operator=(const ConcurrentAVL&) = delete;
+
+        // No thread may use the tree while it is destroyed
+        ~ConcurrentAVL() {
+            clear(root.load());
+            for (auto &node : retired) {
+                delete node.second;
+            }
+        }
+
+        void insert(int key) {
+            lock_guard<mutex> lock(writer);
+            stamp++;
+            Node *newRoot = root.load(memory_order_relaxed);
+            if (insert(newRoot, key)) {
+                publish(newRoot);
+                count.fetch_add(1);
+            }
+        }
+
+        void del(int key) {
+            lock_guard<mutex> lock(writer);
+            stamp++;
+            Node *newRoot = root.load(memory_order_relaxed);
+            if (del(newRoot, key)) {
+                publish(newRoot);
+                count.fetch_sub(1);
+            }
+        }
+
+        bool contains(int key) const {
+            ReadGuard guard;
+            Node *node = root.load();
+            while (node && node->key != key) {
+                node = key < node->key ? node->left : node->right;
+            }
+            return node != nullptr;
+        }
+
+        // Function to find the smallest key greater or equal to key, it returns false if there isn't one
+        bool lowerBound(int key, int &result) const {
+            ReadGuard guard;
+            Node *node = root.load();
+            bool found = false;
+            while (node) {
+                if (node->key >= key) {
+                    result = node->key;
+                    found = true;
+                    node = node->left;
+                } else {
+                    node = node->right;
+                }
+            }
+            return found;
+        }
+
+        size_t size(void) const {
+            return count.load();
+        }
+
+        // Function to check the invariants of the current version
+        bool isValid(void) const {
+            ReadGuard guard;
+            return check(root.load(), (long long)INT32_MIN - 1, (long long)INT32_MAX + 1) >= 0;
+        }
+};
+
+ConcurrentAVL::Slot ConcurrentAVL::slots[ConcurrentAVL::maxReaders];
+atomic <unsigned long long> ConcurrentAVL::epoch(1);
+
+/*
+    * Stress test: writers insert and delete keys of their own residue class while readers search.
+    * The even keys below keyRange are inserted before the test and never deleted, so every reader must always find them;
+    * odd keys are never inserted by anybody, so no reader must ever find them.
+*/
+bool stressTest(int readers, int writers, double seconds) {
+    const int keyRange = 1 << 16;
+    ConcurrentAVL tree;
+    for (int key = 0; key < keyRange; key += 2) tree.insert(key);
+
+    atomic <bool> stop(false);
+    atomic <long long> errors(0);
+    vector <vector <int>> owned(writers); // Keys inserted by every writer at the end of the test
+    vector <thread> threads;
+
+    for (int w = 0; w < writers; w++) {
+        threads.emplace_back([&, w]() {
+            mt19937 rng(w);
+            vector <bool> present(keyRange);
+            while (!stop.load(memory_order_relaxed)) {
+                int key = keyRange + 2 * (int)(rng() % keyRange); // Even keys above keyRange
+                if (key / 2 % writers != w) continue;
+                if (rng() % 2) {
+                    tree.insert(key);
+                    present[(key - keyRange) / 2] = true;
+                } else {
+                    tree.del(key);
+                    present[(key - keyRange) / 2] = false;
+                }
+            }
+            for (int i = 0; i < keyRange; i++) {
+                if (present[i]) owned[w].push_back(keyRange + 2 * i);
+            }
+        });
+    }
+
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r]() {
+            mt19937 rng(1000 + r);
+            while (!stop.load(memory_order_relaxed)) {
+                int key = (int)(rng() % keyRange);
+                if (tree.contains(key) != (key % 2 == 0)) errors++;
+                int next = 0;
+                if (!tree.lowerBound(key, next) || next < key || next % 2 != 0) errors++;
+            }
+        });
+    }
+
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop = true;
+    for (thread &t : threads) t.join();
+
+    size_t expected = keyRange / 2;
+    for (auto &keys : owned) {
+        expected += keys.size();
+        for (int key : keys) {
+            if (!tree.contains(key)) errors++;
+        }
+    }
+    if (tree.size() != expected || !tree.isValid()) errors++;
+
+    cout << "Stress test with " << readers << " readers and " << writers << " writers: "
+         << (errors == 0 ? "passed" : "FAILED") << " (" << errors << " errors)" << endl;
+    return errors == 0;
+}
+
+// Read throughput with a number of readers and one writer, lock free readers against a single global mutex
+void benchmarkThreads(int maxThreads, double seconds) {
+    const int n = 1000000;
+    ConcurrentAVL tree;
+    mt19937 rng(1);
+    for (int i = 0; i < n; i++) tree.insert((int)(rng() % (4 * n)));
+
+    for (int locked = 0; locked < 2; locked++) {
+        for (int threadsCount = 1; threadsCount <= maxThreads; threadsCount *= 2) {
+            mutex global;
+            atomic <bool> stop(false);
+            atomic <long long> reads(0), hits(0);
+            vector <thread> threads;
+
+            threads.emplace_back([&]() { // Writer
+                mt19937 rng(2);
+                while (!stop.load(memory_order_relaxed)) {
+                    int key = (int)(rng() % (4 * n));
+                    if (locked) global.lock();
+                    if (rng() % 2) tree.insert(key); else tree.del(key);
+                    if (locked) global.unlock();
+                }
+            });
+
+            for (int r = 0; r < threadsCount; r++) {
+                threads.emplace_back([&, r]() {
+                    mt19937 rng(100 + r);
+                    long long local = 0, found = 0;
+                    while (!stop.load(memory_order_relaxed)) {
+                        for (int i = 0; i < 256; i++) {
+                            int key = (int)(rng() % (4 * n));
+                            if (locked) global.lock();
+                            found += tree.contains(key);
+                            if (locked) global.unlock();
+                        }
+                        local += 256;
+                    }
+                    reads += local;
+                    hits += found;
+                });
+            }
+
+            this_thread::sleep_for(chrono::duration<double>(seconds));
+            stop = true;
+            for (thread &t : threads) t.join();
+
+            cout << (locked ? "global mutex" : "lock free readers") << ", " << threadsCount << " readers: "
+                 << (long long)(reads / seconds) << " reads/s (" << hits << " hits)" << endl;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "stress") {
+        double seconds = argc > 2 ? stod(argv[2]) : 2;
+        unsigned threads = max(2u, thread::hardware_concurrency());
+        bool passed = stressTest(1, 1, seconds) && stressTest(threads, 2, seconds) && stressTest(2 * threads, threads, seconds);
+        return passed ? 0 : 1;
+    }
+    if (argc > 1 && string(argv[1]) == "bench") {
+        int maxThreads = argc > 2 ? stoi(argv[2]) : 32;
+        double seconds = argc > 3 ? stod(argv[3]) : 1;
+        benchmarkThreads(maxThreads, seconds);
+        return 0;
+    }
+
+    ConcurrentAVL tree;
+    int keys[] = {10, 20, 30, 40, 50, 25};
+
+    vector <thread> writers;
+    for (int key : keys) {
+        writers.emplace_back([&tree, key]() { tree.insert(key); });
+    }
+    for (thread &t : writers) t.join();
+
+    cout << "Concurrent AVL Tree constructed successfully with " << tree.size() << " keys." << endl;
+    cout << "Contains 25: " << (tree.contains(25) ? "yes" : "no") << endl;
+
+    return 0;
+}
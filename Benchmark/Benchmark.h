@@ -0,0 +1,356 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/*
+    * Shared benchmark suite for the trees of the repository.
+    * Every tree includes this header and adds a "suite" mode to its main, so the four programs stay
+    * standalone and are measured with the same workloads and the same output.
+    * A workload is a key distribution, a read ratio and a size. The keys are drawn from a generator seeded
+    * with the workload, so two runs with the same arguments execute exactly the same operations:
+    *   uniform      every key of [0, range) with the same probability
+    *   zipf         key ranks with a Zipf distribution (exponent 0.99), scattered over the range so the
+    *                hot keys are not all neighbours
+    *   sorted       0, 1, 2, ... ascending, wrapping around at the end of the range
+    *   adversarial  0, range - 1, 1, range - 2, ... alternating between the two ends, so consecutive keys
+    *                share no path below the root, and two consecutive keys make a range almost as large
+    *                as the whole tree
+    * Every workload runs in a child process: the peak RSS is the one of the workload alone, and the memory
+    * used by the tree is the growth of the RSS during the build, divided by the elements in the tree.
+    * The result is one JSON object per line on the standard output:
+    *   {"structure":"avl","distribution":"zipf","read_ratio":0.95,"size":1000000,"elements":...,"operations":1000000,
+    *    "seed":..., "build_seconds":..., "ops_per_sec":..., "p50_ns":..., "p99_ns":...,
+    *    "peak_rss_bytes":..., "bytes_per_element":..., "checksum":...}
+    * Compiled with -DTREE_STATS the object also has "build_stats" and "stats", the counters of the
+    * instrumentation during the build and during the operations.
+    * The latency of one operation every latencyStride is measured, the throughput is measured on all of them.
+    * The latencies include the cost of reading the clock, about 20 ns.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../Instrumentation/Instrumentation.h"
+#include "../Trace/Trace.h"
+
+enum KeyDistribution { UNIFORM, ZIPF, SORTED, ADVERSARIAL };
+
+const KeyDistribution suiteDistributions[] = {UNIFORM, ZIPF, SORTED, ADVERSARIAL};
+const double suiteReadRatios[] = {0.5, 0.95}; // Fraction of the operations that are queries
+const long long suiteOperations = 1000000; // Operations of every workload after the build
+const uint64_t suiteSeed = 42;
+const int latencyStride = 8; // One operation every latencyStride is timed
+
+inline const char *distributionName(KeyDistribution distribution) {
+    switch (distribution) {
+        case UNIFORM: return "uniform";
+        case ZIPF: return "zipf";
+        case SORTED: return "sorted";
+        default: return "adversarial";
+    }
+}
+
+// SplitMix64, a small and fast generator that is the same on every platform, unlike the std distributions
+class SplitMix {
+    private:
+        uint64_t state;
+
+    public:
+        explicit SplitMix(uint64_t seed) : state(seed) {}
+
+        uint64_t next(void) {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        // Uniform in [0, bound), the bias is negligible for the bounds used here
+        uint64_t below(uint64_t bound) {
+            return multiplyHigh(next(), bound);
+        }
+
+        // High 64 bits of a * b, from the four products of the 32 bit halves (__int128 is not standard C++)
+        static uint64_t multiplyHigh(uint64_t a, uint64_t b) {
+            uint64_t aLow = a & 0xFFFFFFFF, aHigh = a >> 32, bLow = b & 0xFFFFFFFF, bHigh = b >> 32;
+            uint64_t low = aLow * bLow, middleA = aHigh * bLow, middleB = aLow * bHigh;
+            uint64_t carry = ((low >> 32) + (middleA & 0xFFFFFFFF) + (middleB & 0xFFFFFFFF)) >> 32;
+            return aHigh * bHigh + (middleA >> 32) + (middleB >> 32) + carry;
+        }
+
+        // Uniform in [0, 1)
+        double real(void) {
+            return (next() >> 11) * (1.0 / 9007199254740992.0);
+        }
+};
+
+/*
+    * Zipf distribution over the ranks [1, n] with the rejection-inversion method of Hormann and Derflinger:
+    * O(1) time and memory for every n, so it works for 1e8 keys without a table of probabilities.
+*/
+class ZipfGenerator {
+    private:
+        double exponent, hIntegralFirst, hIntegralLast, threshold;
+        uint64_t n;
+
+        // log1p(x) / x and expm1(x) / x, with their series near 0
+        static double helper1(double x) {
+            return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+        }
+
+        static double helper2(double x) {
+            return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + x / 4));
+        }
+
+        double h(double x) const {
+            return exp(-exponent * log(x));
+        }
+
+        double hIntegral(double x) const {
+            double logX = log(x);
+            return helper2((1 - exponent) * logX) * logX;
+        }
+
+        double hIntegralInverse(double x) const {
+            double t = std::max(x * (1 - exponent), -1.0);
+            return exp(helper1(t) * x);
+        }
+
+    public:
+        ZipfGenerator(uint64_t n, double exponent = 0.99) : exponent(exponent), n(n) {
+            hIntegralFirst = hIntegral(1.5) - 1;
+            hIntegralLast = hIntegral(n + 0.5);
+            threshold = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+        }
+
+        uint64_t next(SplitMix &rng) {
+            while (true) {
+                double u = hIntegralLast + rng.real() * (hIntegralFirst - hIntegralLast);
+                double x = hIntegralInverse(u);
+                uint64_t k = (uint64_t)std::min(std::max(x + 0.5, 1.0), (double)n);
+                if (k - x <= threshold || u >= hIntegral(k + 0.5) - h(k)) return k;
+            }
+        }
+};
+
+// Keys of a workload in [0, range)
+class KeyGenerator {
+    private:
+        KeyDistribution distribution;
+        uint64_t range, counter;
+        SplitMix rng;
+        ZipfGenerator zipf;
+
+    public:
+        KeyGenerator(KeyDistribution distribution, uint64_t range, uint64_t seed)
+            : distribution(distribution), range(std::max(range, (uint64_t)1)), counter(0), rng(seed), zipf(std::max(range, (uint64_t)1)) {}
+
+        uint64_t next(void) {
+            uint64_t i = counter++;
+            switch (distribution) {
+                case UNIFORM: return rng.below(range);
+                case ZIPF: return (zipf.next(rng) - 1) * 0x9E3779B97F4A7C15ULL % range; // Scatter the ranks
+                case SORTED: return i % range;
+                default: {
+                    uint64_t step = (i / 2) % ((range + 1) / 2);
+                    return i % 2 ? range - 1 - step : step;
+                }
+            }
+        }
+
+        // Values and other random choices of the workload, from the same seed
+        uint64_t below(uint64_t bound) {
+            return rng.below(bound);
+        }
+};
+
+struct Workload {
+    KeyDistribution distribution;
+    double readRatio;
+    uint64_t size;
+
+    // Different keys for every size and distribution, the same on every run and for every read ratio,
+    // so the mixes of a size and distribution query the same tree
+    uint64_t seed(void) const {
+        return suiteSeed ^ (size * 0x100000001B3ULL) ^ ((uint64_t)distribution << 56);
+    }
+};
+
+// Resident memory of the process now, from /proc/self/statm
+inline size_t currentRSS(void) {
+    long pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+    if (fscanf(file, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(file);
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// Largest resident memory of the process so far, ru_maxrss is in kilobytes on Linux
+inline size_t peakRSS(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss * 1024;
+}
+
+/*
+    * Measurement of one workload: build the tree between startBuild and endBuild, then call run with the
+    * range of the keys and the operation, a callable operation(read, key, other) that receives true for
+    * a query and false for an update, and two keys of the workload (a point uses key, a range uses both).
+    * It returns a value for the checksum, so the compiler cannot drop the queries.
+    * The keys of the operations come from a new generator of the same distribution: the sorted and
+    * adversarial keys start again from the ends of the range, and the Zipf keys have the same hot keys
+    * of the build. They are drawn a block at a time outside of the timed loop, so the cost of the
+    * generator (a Zipf key takes a few logarithms) is not measured as the cost of the tree.
+*/
+class BenchmarkRun {
+    private:
+        std::string structure;
+        Workload workload;
+        size_t rssBefore, rssBuilt;
+        uint64_t elements; // Elements in the tree after the build, fewer than the size if keys repeat
+        std::chrono::steady_clock::time_point buildBegin;
+        double buildSeconds;
+        StatsSnapshot buildStats;
+
+        static void printStats(const char *field, const StatsSnapshot &stats) {
+            printf(",\"%s\":{", field);
+            for (size_t i = 0; i < stats.size(); i++) {
+                printf("%s\"%s\":%llu", i ? "," : "", stats[i].first.c_str(), (unsigned long long)stats[i].second);
+            }
+            printf("}");
+        }
+
+    public:
+        BenchmarkRun(const std::string &structure, const Workload &workload)
+            : structure(structure), workload(workload), rssBefore(0), rssBuilt(0), elements(workload.size), buildSeconds(0) {}
+
+        void startBuild(void) {
+            TreeStats::reset();
+            rssBefore = currentRSS();
+            buildBegin = std::chrono::steady_clock::now();
+        }
+
+        void endBuild(uint64_t elements) {
+            this->elements = elements;
+            buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildBegin).count();
+            rssBuilt = currentRSS();
+            buildStats = TreeStats::snapshot();
+            TreeStats::reset();
+        }
+
+        template <class Operation>
+        void run(uint64_t range, Operation operation, long long operations = suiteOperations) {
+            const int block = 1024;
+            KeyGenerator keys(workload.distribution, range, workload.seed() + 1);
+            SplitMix rng(workload.seed() + 2);
+            uint64_t reads = (uint64_t)(workload.readRatio * 4294967296.0);
+            std::vector <uint64_t> blockKeys(2 * block);
+            std::vector <char> blockReads(block);
+            std::vector <uint32_t> latencies;
+            latencies.reserve(operations / latencyStride + 1);
+            long long checksum = 0;
+            double seconds = 0;
+
+            for (long long first = 0; first < operations; first += block) {
+                int count = (int)std::min<long long>(block, operations - first);
+                for (int i = 0; i < count; i++) {
+                    blockKeys[2 * i] = keys.next();
+                    blockKeys[2 * i + 1] = keys.next();
+                    blockReads[i] = (rng.next() >> 32) < reads;
+                }
+                auto begin = std::chrono::steady_clock::now();
+                for (int i = 0; i < count; i++) {
+                    if (i % latencyStride) {
+                        checksum += operation(blockReads[i] != 0, blockKeys[2 * i], blockKeys[2 * i + 1]);
+                        continue;
+                    }
+                    auto start = std::chrono::steady_clock::now();
+                    checksum += operation(blockReads[i] != 0, blockKeys[2 * i], blockKeys[2 * i + 1]);
+                    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                    latencies.push_back((uint32_t)std::min<long long>(nanoseconds, UINT32_MAX));
+                }
+                seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            }
+
+            auto percentile = [&](double p) -> uint32_t {
+                if (latencies.empty()) return 0;
+                auto it = latencies.begin() + (size_t)(p * (latencies.size() - 1));
+                std::nth_element(latencies.begin(), it, latencies.end());
+                return *it;
+            };
+            uint32_t p50 = percentile(0.50), p99 = percentile(0.99);
+            double bytesPerElement = rssBuilt > rssBefore ? (double)(rssBuilt - rssBefore) / std::max(elements, (uint64_t)1) : 0;
+
+            printf("{\"structure\":\"%s\",\"distribution\":\"%s\",\"read_ratio\":%.2f,\"size\":%llu,\"elements\":%llu,\"operations\":%lld,"
+                   "\"seed\":%llu,\"build_seconds\":%.6f,\"ops_per_sec\":%.0f,\"p50_ns\":%u,\"p99_ns\":%u,"
+                   "\"peak_rss_bytes\":%zu,\"bytes_per_element\":%.2f,\"checksum\":%lld",
+                   structure.c_str(), distributionName(workload.distribution), workload.readRatio,
+                   (unsigned long long)workload.size, (unsigned long long)elements, operations, (unsigned long long)workload.seed(), buildSeconds,
+                   seconds > 0 ? operations / seconds : 0.0, p50, p99, peakRSS(), bytesPerElement, checksum);
+            if (TreeStats::enabled) {
+                printStats("build_stats", buildStats);
+                printStats("stats", TreeStats::snapshot());
+            }
+            printf("}\n");
+            fflush(stdout);
+        }
+};
+
+/*
+    * Function to run every workload of the suite for the sizes, each one in a child process.
+    * benchmark(workload) builds the tree and measures it with a BenchmarkRun.
+    * A workload that fails (for example out of memory at 1e8) prints an error object and the suite goes on.
+    * Returns false if a workload failed.
+*/
+template <class Benchmark>
+bool runSuite(const std::string &structure, const std::vector <uint64_t> &sizes, Benchmark benchmark) {
+    bool passed = true;
+    for (uint64_t size : sizes) {
+        for (KeyDistribution distribution : suiteDistributions) {
+            for (double readRatio : suiteReadRatios) {
+                Workload workload{distribution, readRatio, size};
+                fflush(stdout);
+                std::cout.flush();
+                pid_t child = fork();
+                if (child == 0) {
+                    try {
+                        benchmark(workload);
+                    } catch (const std::exception &error) {
+                        fprintf(stderr, "%s: %s\n", structure.c_str(), error.what());
+                        _exit(1);
+                    }
+                    fflush(stdout);
+                    TREE_TRACE_FLUSH(); // _exit doesn't run the destructor of the recorder
+                    _exit(0);
+                }
+                int status = 0;
+                if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    printf("{\"structure\":\"%s\",\"distribution\":\"%s\",\"read_ratio\":%.2f,\"size\":%llu,\"error\":\"failed\"}\n",
+                           structure.c_str(), distributionName(distribution), readRatio, (unsigned long long)size);
+                    fflush(stdout);
+                    passed = false;
+                }
+            }
+        }
+    }
+    return passed;
+}
+
+// Sizes from the command line, starting at argv[first], by default 1e3 to 1e6
+inline std::vector <uint64_t> suiteSizes(int argc, char **argv, int first) {
+    std::vector <uint64_t> sizes;
+    for (int i = first; i < argc; i++) sizes.push_back((uint64_t)std::stod(argv[i])); // Accepts 1e8
+    if (sizes.empty()) sizes = {1000, 10000, 100000, 1000000};
+    return sizes;
+}
+
+#endif
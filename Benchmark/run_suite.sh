@@ -0,0 +1,20 @@
+#!/bin/sh
+# Compile the four trees and run the shared benchmark suite on all of them.
+# Usage: Benchmark/run_suite.sh [output] [sizes...]
+# The results are JSON lines, appended to output (by default benchmark_results.jsonl).
+# The default sizes are 1e3 to 1e6, 1e7 and 1e8 need a few GB of memory for the pointer trees.
+set -e
+cd "$(dirname "$0")/.."
+output=${1:-benchmark_results.jsonl}
+[ $# -gt 0 ] && shift
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+for source in AVL_tree/AVL_tree.cpp Segment_tree/Static_Segment_tree.cpp \
+              Segment_tree/Dynamic_Segment_tree.cpp Verctor_Tree/Vector_tree.cpp; do
+    program="$build/$(basename "$source" .cpp)"
+    echo "compiling $source" >&2
+    ${CXX:-g++} -std=c++17 -O2 -pthread ${CXXFLAGS} "$source" -o "$program"
+    echo "running $program suite $*" >&2
+    "$program" suite "$@" | tee -a "$output" || echo "$source: some workloads failed" >&2
+done
@@ -0,0 +1,200 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+/*
+    * Counters on the hot paths of the trees, compiled only with -DTREE_STATS.
+    * Without it the macros are empty statements, so the trees are exactly the same code as before.
+    *   TREE_COUNT("name")          adds 1 to the counter name
+    *   TREE_ADD("name", amount)    adds amount to the counter name
+    *   TREE_TIME("name")           times the rest of the scope into name_nanoseconds and name_calls,
+    *                               only with -DTREE_STATS_TIMING too, because reading the clock costs ~20 ns
+    *   TREE_STATS_DUMP(out)        writes every counter to out in the Prometheus text format
+    * A counter is registered by name the first time its macro runs, then the macro only adds to a slot
+    * of an array owned by the calling thread: there are no shared cache lines and no atomic read-modify-write.
+    * After 127 names the new counters are added to stats_overflow, so a full registry never changes another counter.
+    * Only the owner thread writes its slots, with relaxed atomic stores, so TreeStats::snapshot can read
+    * all of them from any thread without stopping the others. The counts of a thread that ends are
+    * added to the totals of the registry, so they are not lost.
+    * The TreeStats class exists also without TREE_STATS: snapshot returns no counters and dump writes nothing.
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef TREE_STATS
+#include <chrono>
+#include <mutex>
+#endif
+
+typedef std::vector <std::pair <std::string, uint64_t>> StatsSnapshot; // Name and value of every counter
+
+#ifdef TREE_STATS
+
+class TreeStats {
+    public:
+        static const int maxCounters = 128; // Slots of a thread: different counter names in a program, plus the overflow
+
+    private:
+        struct ThreadCounters { // Slots of one thread, only that thread writes them
+            std::atomic <uint64_t> values[maxCounters];
+
+            ThreadCounters(void) {
+                for (auto &value : values) value.store(0, std::memory_order_relaxed);
+                Registry &all = registry();
+                std::lock_guard <std::mutex> lock(all.lock);
+                all.threads.push_back(this);
+            }
+
+            ~ThreadCounters(void) {
+                Registry &all = registry();
+                std::lock_guard <std::mutex> lock(all.lock);
+                for (int i = 0; i < maxCounters; i++) all.retired[i] += values[i].load(std::memory_order_relaxed);
+                for (size_t i = 0; i < all.threads.size(); i++) {
+                    if (all.threads[i] == this) {
+                        all.threads[i] = all.threads.back();
+                        all.threads.pop_back();
+                        break;
+                    }
+                }
+            }
+        };
+
+        struct Registry {
+            std::mutex lock;
+            std::vector <std::string> names; // Name of every counter, the index is its slot
+            std::vector <ThreadCounters*> threads; // Threads that are running
+            uint64_t retired[maxCounters] = {}; // Counts of the threads that ended
+            uint64_t baseline[maxCounters] = {}; // Totals at the last reset
+        };
+
+        static Registry &registry(void) {
+            static Registry all;
+            return all;
+        }
+
+        static ThreadCounters &local(void) {
+            thread_local ThreadCounters counters;
+            return counters;
+        }
+
+        // Sum of every counter over all the threads, with the registry locked
+        static void totals(Registry &all, uint64_t *result) {
+            for (int i = 0; i < maxCounters; i++) result[i] = all.retired[i];
+            for (ThreadCounters *thread : all.threads) {
+                for (size_t i = 0; i < all.names.size(); i++) result[i] += thread->values[i].load(std::memory_order_relaxed);
+            }
+        }
+
+    public:
+        static const bool enabled = true;
+
+        // Slot of the counter name, registered the first time. The macros call it once for every place they are used
+        static int counter(const std::string &name) {
+            Registry &all = registry();
+            std::lock_guard <std::mutex> lock(all.lock);
+            for (size_t i = 0; i < all.names.size(); i++) {
+                if (all.names[i] == name) return (int)i;
+            }
+            if ((int)all.names.size() >= maxCounters - 1) { // Full: the last slot collects the rest under its own name
+                if ((int)all.names.size() == maxCounters - 1) all.names.push_back("stats_overflow");
+                return maxCounters - 1;
+            }
+            all.names.push_back(name);
+            return (int)all.names.size() - 1;
+        }
+
+        static void add(int id, uint64_t amount) {
+            std::atomic <uint64_t> &value = local().values[id];
+            value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+        // Value of every counter since the last reset, in order of registration
+        static StatsSnapshot snapshot(void) {
+            Registry &all = registry();
+            std::lock_guard <std::mutex> lock(all.lock);
+            uint64_t sums[maxCounters];
+            totals(all, sums);
+            StatsSnapshot result;
+            for (size_t i = 0; i < all.names.size(); i++) result.emplace_back(all.names[i], sums[i] - all.baseline[i]);
+            return result;
+        }
+
+        // Start every counter again from 0, the threads keep counting while it runs
+        static void reset(void) {
+            Registry &all = registry();
+            std::lock_guard <std::mutex> lock(all.lock);
+            totals(all, all.baseline);
+        }
+
+        // Prometheus text format: every counter is tree_<name>_total
+        static void dump(std::ostream &out) {
+            for (auto &entry : snapshot()) {
+                out << "# TYPE tree_" << entry.first << "_total counter\n";
+                out << "tree_" << entry.first << "_total " << entry.second << "\n";
+            }
+            out.flush();
+        }
+};
+
+// Adds the time from its creation to its destruction to a pair of counters
+class ScopeTimer {
+    private:
+        int nanoseconds, calls;
+        std::chrono::steady_clock::time_point begin;
+
+    public:
+        ScopeTimer(int nanoseconds, int calls) : nanoseconds(nanoseconds), calls(calls), begin(std::chrono::steady_clock::now()) {}
+
+        ~ScopeTimer(void) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+            TreeStats::add(nanoseconds, (uint64_t)elapsed);
+            TreeStats::add(calls, 1);
+        }
+};
+
+#define TREE_ADD(name, amount) do { \
+        static const int treeStatsId = TreeStats::counter(name); \
+        TreeStats::add(treeStatsId, (uint64_t)(amount)); \
+    } while (0)
+#define TREE_COUNT(name) TREE_ADD(name, 1)
+#define TREE_STATS_DUMP(out) TreeStats::dump(out)
+
+#ifdef TREE_STATS_TIMING
+#define TREE_TIME(name) TREE_TIME_AT(name, __LINE__)
+#define TREE_TIME_AT(name, line) TREE_TIME_LINE(name, line) // Expands __LINE__ before it's pasted
+#define TREE_TIME_LINE(name, line) \
+    static const int treeTimerNanoseconds##line = TreeStats::counter(std::string(name) + "_nanoseconds"); \
+    static const int treeTimerCalls##line = TreeStats::counter(std::string(name) + "_calls"); \
+    ScopeTimer treeTimer##line(treeTimerNanoseconds##line, treeTimerCalls##line)
+#else
+#define TREE_TIME(name) do {} while (0)
+#endif
+
+#else
+
+// Without TREE_STATS the counters don't exist and every macro is an empty statement
+class TreeStats {
+    public:
+        static const bool enabled = false;
+
+        static StatsSnapshot snapshot(void) {
+            return StatsSnapshot();
+        }
+
+        static void reset(void) {}
+
+        static void dump(std::ostream &) {}
+};
+
+#define TREE_ADD(name, amount) do {} while (0)
+#define TREE_COUNT(name) do {} while (0)
+#define TREE_TIME(name) do {} while (0)
+#define TREE_STATS_DUMP(out) do {} while (0)
+
+#endif
+
+#endif
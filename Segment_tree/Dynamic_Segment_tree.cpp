@@ -1,137 +1,867 @@
-#include<iostream>
-#include<algorithm>
-#include<vector>
-using namespace std;
-
-/*
-    * This function implements a dynamic segment tree with lazy propagation.
-    * It allows for efficient range updates and range queries on an array.
-    * The segment tree supports multiple versions, enabling historical queries.
-    * It can insert values at specific indices and update ranges by adding a value to all elements in that range.
-    * The sum of elements in a specified range can be queried for any version of the segment tree.
-*/
-
-class DynamicST {
-   private:
-       struct Node { // Structure for Dynamic Segment Tree Node
-           int start, end, sum, update; // Start and end indices of the segment, sum of the segment, and update value
-           Node *left, *right; // Pointers to the left and right children
-   
-           Node(int s, int e) : start(s), end(e), sum(0), update(0), left(nullptr), right(nullptr) {}
-       };
-
-        vector <Node*> roots; // Vector to store roots of different versions of the segment tree
-        int currentVersion; // Current version of the segment tree
-        int size; // Size of the segment tree
-
-        void push(Node *&node) {
-            if (node && node->update != 0) {
-                node->sum += (node->end - node->start + 1) * node->update; // Update the sum with the lazy value
-                if (node->left) {
-                    node->left->update += node->update; // Propagate the update to the left child
-                }
-                if (node->right) {
-                    node->right->update += node->update; // Propagate the update to the right child
-                }
-                node->update = 0; // Reset the update value after pushing
-            }
-        }
-
-        void insert(int key, int value, Node *&node, int start = 0, int end = -1) {
-            if (end == -1) end = size - 1; // Set end index if not provided
-            if (!node) {
-                node = new Node(start, end); // Create a new node if it doesn't exist
-            }
-
-            push(node); // Push any pending updates
-
-            if (key < start || key > end) return; // Out of range
-
-            if (start == end) {
-                node->sum == value; // Update the sum at the leaf node
-                return;
-            }
-
-            int mid = start + (end - start) / 2; // Calculate the midpoint
-            if (key <= mid) {
-                insert(key, value, node->left, start, mid); // Insert in the left subtree
-            } else {
-                insert(key, value, node->right, mid + 1, end); // Insert in the right subtree
-            }
-        }
-
-        void UpdateRange(Node *&node, int start, int end, int value) {
-            if (!node || start > node->end || end < node->start) return; // Out of range
-
-            push(node); // Push any pending updates
-
-            if (start <= node->start && end >= node->end) {
-                node->update += value; // Apply the update lazily
-                push(node); // Push the update to the current node
-                return;
-            }
-
-            UpdateRange(node->left, start, end, value); // Update left subtree
-            UpdateRange(node->right, start, end, value); // Update right subtree
-
-            node->sum = (node->left ? node->left->sum : 0) + (node->right ? node->right->sum : 0); // Recalculate sum
-        }
-
-        int GetSum(Node *&node, int start, int end) {
-            if (!node || start > node->end || end < node->start) return 0; // Out of range
-
-            push(node); // Push any pending updates
-
-            if (start <= node->start && end >= node->end) {
-                return node->sum; // Return the sum if the range matches
-            }
-
-            int mid = node->start + (node->end - node->start) / 2; // Calculate the midpoint
-            return GetSum(node->left, start, end) + GetSum(node->right, start, end); // Sum from both subtrees
-        }
-
-    public:
-        DynamicST(int size) : size(size), currentVersion(0) {
-            roots.push_back(nullptr); // Initialize with a null root for version 0
-        }
-
-        void insert(int key, int value) {
-            insert(key, value, roots[currentVersion]);
-            currentVersion++;
-            roots.push_back(roots[currentVersion - 1]); // Create a new version based on the previous one
-        }
-
-        void UpdateRange(int start, int end, int value){
-            UpdateRange(roots[currentVersion], start, end, value);
-            currentVersion++;
-            roots.push_back(roots[currentVersion - 1]); // Create a new version based on the previous one
-        }
-
-        int GetSum(int start, int end, int version = -1) {
-            if (version = -1) version = currentVersion; // Use the current version if not specified
-            return GetSum(roots[version], start, end);
-        }
-
-};
-
-/*
-    You can use this dynamic segment tree to perform operations like inserting values,
-    updating ranges, and querying sums efficiently. you can create multiple versions of the segment tree
-    to keep track of historical changes, allowing you to query the state of the segment tree at any previous version.
-    This implementation supports lazy propagation for efficient range updates.
-    You acn also modify the code to support more complex operations like range minimum queries, range maximum queries, etc.
-    You can insert nested structures or additional variables in the Node structure to store more information,
-    such as the number of elements in the segment, which can be useful for other operations.
-*/
-
-int main() {
-    DynamicST segTree(100); // Create a dynamic segment tree with size 100
-
-    segTree.insert(1, 5); // Insert value 5 at index 1
-    segTree.insert(2, 10); // Insert value 10 at index 2
-    segTree.UpdateRange(1, 2, 3); // Update range [1, 2] by adding 3
-
-    cout << "Sum from index 1 to 2: " << segTree.GetSum(1, 2) << endl; // Should output 21 (5 + 10 + 3)
-
-    return 0;
-}
+#include<iostream>
+#include<algorithm>
+#include<vector>
+#include<random>
+#include<chrono>
+#include<string>
+#include<stdexcept>
+#include<deque>
+#include<set>
+#include<atomic>
+#include<thread>
+#include<cstdint>
+#include<climits>
+#include "../Instrumentation/Instrumentation.h"
+#include "../Trace/Trace.h"
+#include "../Benchmark/Benchmark.h"
+using namespace std;
+
+/*
+    * This function implements a dynamic segment tree with lazy propagation.
+    * It allows for efficient range updates and range queries on an array.
+    * The segment tree supports multiple versions, enabling historical queries.
+    * It can insert values at specific indices and update ranges by adding a value to all elements in that range.
+    * The sum of elements in a specified range can be queried for any version of the segment tree.
+    * The indices are 64 bit keys: the tree covers [0, 2^64) and creates nodes only where keys and updates are.
+    * The sums are computed modulo 2^64 and read as long long, so they are exact when the result fits in it.
+    * The versions are persistent: an update copies only the O(log n) nodes it changes and shares the others
+    * with the previous version, and the lazy values stay in the node where they are applied instead of
+    * being pushed to the children, so a node is never modified after it's created.
+    * Old versions can be released with a retention policy (keep the last N versions and the checkpoints):
+    * every node counts the versions and the nodes that point to it, and a node that is not used anymore
+    * is freed a few at a time by collect, so a long running program doesn't grow without bound.
+    * One writer and many readers can use the tree together: the readers query any version without locks
+    * and without writing, and a node is freed only when no reader can still see it.
+*/
+
+typedef uint64_t Key;
+
+class DynamicST {
+   private:
+       struct Node { // Structure for Dynamic Segment Tree Node, 32 bytes
+           uint64_t sum, update; // Sum of the segment with the updates of this node and below, value added to the whole segment
+           uint32_t refs; // Number of roots and nodes that point to this node
+           uint32_t leaf; // 1 if the segment contains only one key
+           union {
+               uint32_t child[2]; // Indices of the left and right children in the pool, 0 is a missing child
+               Key key; // Key of a leaf
+           };
+       };
+       // A node doesn't store its segment: the root of a version is [0, 2^level) and a node at level l (2^l keys)
+       // has the two halves as children, so the segment is computed on the way down. The level of the root
+       // grows with the largest key, so small keys don't need a path from level 64.
+       // A missing child is a segment of zeros. A segment with only one key is a leaf at the level where
+       // the key is alone, not a path down to level 0: its sum is the value of the key plus update * length.
+       // A node with references is never modified because it can be part of many versions.
+
+        static const int slabBits = 16;
+        static const uint32_t slabSize = 1 << slabBits; // Number of nodes allocated together
+        static const uint32_t maxSlabs = 1 << (32 - slabBits); // Enough slabs for every 32 bit index
+
+        struct Root { // Root of a version, its segment is [0, 2^level)
+            uint32_t node;
+            int level;
+        };
+
+        struct Version {
+            Root root; // Written once, before the version is published
+            atomic <bool> live; // False after the version is released
+        };
+
+        static const int chunkBits = 16;
+        static const int chunkSize = 1 << chunkBits; // Number of versions allocated together
+        static const int maxChunks = 1 << (31 - chunkBits); // Enough chunks for every int version
+
+        /*
+            * Epoch based reclamation, like in the concurrent AVL tree.
+            * Every reader thread owns a slot where it announces the global epoch while it is reading.
+            * A node released at epoch e is freed only when every busy slot announces an epoch greater than e,
+            * because those readers started after its last version was released and cannot reach it.
+        */
+        static const int maxReaders = 256; // Maximum number of threads reading at the same time
+
+        struct alignas(64) Slot {
+            atomic <unsigned long long> epoch; // 0 means that the thread is not reading
+            atomic <bool> used; // True if the slot belongs to a thread
+        };
+
+        static Slot slots[maxReaders];
+
+        // Every thread takes a slot the first time it reads and gives it back when it ends
+        struct SlotOwner {
+            int index;
+
+            SlotOwner(void) : index(-1) {
+                for (int i = 0; i < maxReaders; i++) {
+                    bool expected = false;
+                    if (!slots[i].used.load(memory_order_relaxed) && slots[i].used.compare_exchange_strong(expected, true)) {
+                        index = i;
+                        return;
+                    }
+                }
+                throw runtime_error("Too many reader threads");
+            }
+
+            ~SlotOwner() {
+                slots[index].epoch.store(0);
+                slots[index].used.store(false);
+            }
+        };
+
+        static Slot &mySlot(void) {
+            thread_local SlotOwner owner;
+            return slots[owner.index];
+        }
+
+        // A reader is inside the guard while it walks a version
+        class ReadGuard {
+            private:
+                Slot &slot;
+            public:
+                ReadGuard(void) : slot(mySlot()) {
+                    slot.epoch.store(epoch.load());
+                    // The announce must be visible before the loads of find: paired with the fence of oldestReader,
+                    // either the writer sees the announce or the reader sees live == false
+                    atomic_thread_fence(memory_order_seq_cst);
+                }
+                ~ReadGuard() {
+                    slot.epoch.store(0, memory_order_release);
+                }
+        };
+
+        static atomic <unsigned long long> epoch; // Shared by all the trees, like the slots
+
+        // The readers only use the published versions, the slabs and the chunks; everything else belongs to the writer
+        atomic <Version*> *chunks; // Versions: version i is chunks[i / chunkSize][i % chunkSize], null when all of them are released
+        atomic <int> currentVersion; // Last published version
+        vector <int> liveInChunk; // Number of versions not released in every chunk
+        set <int> checkpoints; // Versions kept also when they are out of the retention window
+        int firstVersion; // Oldest version in the retention window
+        int keepLast; // Number of versions in the retention window, 0 to keep all of them
+        size_t collectStep; // Number of nodes freed after every operation
+        vector <uint32_t> dying; // Roots of the versions released by this operation
+        vector <Version*> dyingChunks; // Chunks released by this operation
+        vector <pair <unsigned long long, Version*>> retiredChunks; // Chunks waiting to be freed, with their epoch
+
+        Node **slabs; // Pool of nodes: node i is slabs[i / slabSize][i % slabSize], node 0 is not used
+        uint32_t allocated; // Number of nodes taken from the slabs
+        uint32_t freeList; // Freed nodes, linked by child[0]
+        deque <pair <unsigned long long, uint32_t>> garbage; // Nodes without references whose children are not released yet, with their epoch
+        unsigned long long released; // Epoch of the last retire, the nodes released now are invisible to the readers that start after it
+        unsigned long long oldest; // Every node released before this epoch is invisible to the readers
+        size_t nodes; // Number of nodes not freed
+
+        Node &at(uint32_t index) {
+            return slabs[index >> slabBits][index & (slabSize - 1)];
+        }
+
+        const Node &at(uint32_t index) const {
+            return slabs[index >> slabBits][index & (slabSize - 1)];
+        }
+
+        // Number of keys of a segment at level, modulo 2^64 like the sums
+        static uint64_t length(int level) {
+            return level >= 64 ? 0 : 1ULL << level;
+        }
+
+        // Function to get a node of zeros without references
+        uint32_t allocate(void) {
+            TREE_COUNT("dynamic_segment_tree_node_allocations");
+            uint32_t index;
+            if (freeList) {
+                index = freeList; // Reuse the last freed node
+                freeList = at(index).child[0];
+            } else {
+                if (allocated == UINT32_MAX) throw length_error("DynamicST: too many nodes");
+                if (allocated % slabSize == 0) slabs[allocated >> slabBits] = new Node[slabSize];
+                index = allocated++;
+            }
+            nodes++;
+            Node &node = at(index);
+            node.sum = node.update = 0;
+            node.refs = node.leaf = 0;
+            node.key = 0;
+            return index;
+        }
+
+        void recycle(uint32_t index) {
+            TREE_COUNT("dynamic_segment_tree_nodes_freed");
+            at(index).child[0] = freeList;
+            freeList = index;
+            nodes--;
+        }
+
+        uint32_t makeLeaf(Key key, uint64_t value) {
+            uint32_t index = allocate();
+            Node &node = at(index);
+            node.leaf = 1;
+            node.key = key;
+            node.sum = value;
+            return index;
+        }
+
+        // Function to get a node that can be modified: the node itself if it was created by this
+        // operation (no references yet, no reader can see it), otherwise a copy of it
+        uint32_t writable(uint32_t index) {
+            if (at(index).refs == 0) return index;
+            uint32_t created = allocate();
+            at(created) = at(index);
+            at(created).refs = 0;
+            return created;
+        }
+
+        void retain(uint32_t index) {
+            if (index) at(index).refs++;
+        }
+
+        // A node without references waits in garbage until no reader can be walking it
+        void release(uint32_t index) {
+            if (index && --at(index).refs == 0) garbage.push_back(make_pair(released, index));
+        }
+
+        // Function to add the references of a new node to its children, when they are final
+        uint32_t adopt(uint32_t index) {
+            const Node &node = at(index);
+            if (!node.leaf) {
+                retain(node.child[0]);
+                retain(node.child[1]);
+            }
+            return index;
+        }
+
+        uint64_t sum(uint32_t index) const {
+            return index ? at(index).sum : 0;
+        }
+
+        void recompute(uint32_t index, int level) {
+            Node &node = at(index);
+            node.sum = sum(node.child[0]) + sum(node.child[1]) + node.update * length(level);
+        }
+
+        // Function to turn a leaf at level > 0 into a node with the leaf in the child that contains the key
+        uint32_t split(uint32_t index, int level) {
+            Node leaf = at(index);
+            if (leaf.refs == 0) recycle(index); // Created by this operation, nothing else points to it
+
+            uint32_t created = allocate();
+            Node &node = at(created);
+            node.update = leaf.update;
+            node.sum = leaf.sum;
+            node.child[(leaf.key >> (level - 1)) & 1] = makeLeaf(leaf.key, leaf.sum - leaf.update * length(level));
+            return created;
+        }
+
+        // Function to set key to value in the segment of index [lo, lo + 2^level), pending is the sum of the
+        // updates of the ancestors. It returns the new root of the segment.
+        uint32_t insert(uint32_t index, Key lo, int level, Key key, uint64_t value, uint64_t pending) {
+            if (!index) return makeLeaf(key, value - pending); // The key is alone in the segment
+            if (level == 0) { // Only this key, the node can have an update without being a leaf
+                uint32_t created = writable(index);
+                Node &node = at(created);
+                node.leaf = 1;
+                node.key = key;
+                node.update = 0;
+                node.sum = value - pending; // The ancestors will add pending
+                return created;
+            }
+
+            uint32_t created;
+            if (at(index).leaf) {
+                if (at(index).key == key) { // Same key at a higher level
+                    created = writable(index);
+                    Node &node = at(created);
+                    node.sum = value - pending - node.update + node.update * length(level); // The ancestors will add pending
+                    return created;
+                }
+                created = split(index, level);
+            } else {
+                created = writable(index);
+            }
+
+            Node &node = at(created);
+            int side = (key >> (level - 1)) & 1;
+            uint32_t child = insert(node.child[side], lo + side * length(level - 1), level - 1, key, value, pending + node.update);
+            at(created).child[side] = child;
+            recompute(created, level);
+            return adopt(created);
+        }
+
+        // Function to add value to [l, r] in the segment [lo, lo + 2^level), it returns the new root of the segment.
+        // Only the nodes on the paths to l and r and the nodes that cover a part of [l, r] are copied.
+        uint32_t UpdateRange(uint32_t index, Key lo, int level, Key l, Key r, uint64_t value) {
+            Key hi = lo + (length(level) - 1);
+            if (r < lo || l > hi) return index; // Out of range, the node is shared with the previous version
+
+            if (l <= lo && r >= hi) {
+                uint32_t created = index ? writable(index) : allocate();
+                Node &node = at(created);
+                node.update += value; // The tag stays in the node, the children are not copied
+                node.sum += value * length(level);
+                return adopt(created);
+            }
+
+            uint32_t created;
+            if (!index) created = allocate();
+            else if (at(index).leaf) created = split(index, level);
+            else created = writable(index);
+
+            uint64_t half = length(level - 1);
+            uint32_t left = UpdateRange(at(created).child[0], lo, level - 1, l, r, value); // Update left subtree
+            uint32_t right = UpdateRange(at(created).child[1], lo + half, level - 1, l, r, value); // Update right subtree
+            at(created).child[0] = left;
+            at(created).child[1] = right;
+            recompute(created, level); // Recalculate sum
+            return adopt(created);
+        }
+
+        // Function to get the sum of [l, r] in the segment [lo, lo + 2^level), pending is the sum of the updates of the ancestors
+        uint64_t GetSum(uint32_t index, Key lo, int level, Key l, Key r, uint64_t pending) const {
+            Key hi = lo + (length(level) - 1);
+            if (r < lo || l > hi) return 0; // Out of range
+            uint64_t overlap = min(r, hi) - max(l, lo) + 1;
+            if (!index) return pending * overlap; // Only the updates of the ancestors
+            TREE_COUNT("dynamic_segment_tree_getsum_nodes");
+
+            const Node &node = at(index);
+            if (l <= lo && r >= hi) {
+                return node.sum + pending * length(level); // Return the sum if the range matches
+            }
+            if (node.leaf) {
+                uint64_t value = node.sum - node.update * length(level);
+                return (node.update + pending) * overlap + (node.key >= l && node.key <= r ? value : 0);
+            }
+
+            pending += node.update;
+            uint64_t half = length(level - 1);
+            return GetSum(node.child[0], lo, level - 1, l, r, pending) + GetSum(node.child[1], lo + half, level - 1, l, r, pending); // Sum from both subtrees
+        }
+
+        // Function to get the entry of a version that is not released, null otherwise
+        const Version *find(int version) const {
+            if (version < 0 || version > currentVersion.load(memory_order_acquire)) return nullptr;
+            const Version *chunk = chunks[version >> chunkBits].load(memory_order_acquire);
+            if (!chunk || !chunk[version & (chunkSize - 1)].live.load(memory_order_acquire)) return nullptr;
+            return &chunk[version & (chunkSize - 1)];
+        }
+
+        Root root(int version) const {
+            const Version *entry = find(version);
+            if (!entry) throw out_of_range("DynamicST: version " + to_string(version) + " does not exist");
+            return entry->root;
+        }
+
+        // Function to release a version: the readers that start now don't see it anymore,
+        // its root is released by retire when the epoch has moved on
+        void kill(int version) {
+            int chunk = version >> chunkBits;
+            Version *entries = chunks[chunk].load(memory_order_relaxed);
+            entries[version & (chunkSize - 1)].live.store(false, memory_order_release);
+            dying.push_back(entries[version & (chunkSize - 1)].root.node);
+            if (--liveInChunk[chunk] == 0 && chunk < (currentVersion.load(memory_order_relaxed) >> chunkBits)) {
+                chunks[chunk].store(nullptr, memory_order_release);
+                dyingChunks.push_back(entries);
+            }
+        }
+
+        // Function to release the versions that are out of the retention window
+        void trim(void) {
+            int current = currentVersion.load(memory_order_relaxed);
+            while (keepLast > 0 && current - firstVersion + 1 > keepLast) {
+                if (!checkpoints.count(firstVersion)) kill(firstVersion);
+                firstVersion++;
+            }
+        }
+
+        // Function to start a new epoch and release the roots of the killed versions with it
+        void retire(void) {
+            released = epoch.fetch_add(1);
+            for (uint32_t node : dying) release(node);
+            for (Version *chunk : dyingChunks) retiredChunks.push_back(make_pair(released, chunk));
+            dying.clear();
+            dyingChunks.clear();
+        }
+
+        // Function to publish a new version: the entry is written before the counter, so a reader that sees the counter sees the entry
+        void addVersion(Root root) {
+            if (currentVersion.load(memory_order_relaxed) == INT_MAX) throw length_error("DynamicST: too many versions");
+            TREE_COUNT("dynamic_segment_tree_versions");
+            int version = currentVersion.load(memory_order_relaxed) + 1;
+            int chunk = version >> chunkBits;
+            if ((version & (chunkSize - 1)) == 0) {
+                chunks[chunk].store(new Version[chunkSize], memory_order_release);
+                liveInChunk.push_back(0);
+            }
+            Version &entry = chunks[chunk].load(memory_order_relaxed)[version & (chunkSize - 1)];
+            retain(root.node);
+            entry.root = root;
+            entry.live.store(true, memory_order_relaxed);
+            liveInChunk[chunk]++;
+            currentVersion.store(version, memory_order_release);
+            trim();
+            retire();
+            collect(collectStep);
+        }
+
+        // Function to get the root of the current version with a level that contains last.
+        // Every new level is a node with the old root as left child; the returned root has a reference
+        // that the caller releases after the operation, so the operation copies it instead of changing it.
+        Root grow(Key last) {
+            Root root = this->root(currentVersion.load(memory_order_relaxed));
+            while (root.level < 64 && last >= length(root.level)) {
+                if (root.node) {
+                    uint32_t created = allocate();
+                    at(created).child[0] = root.node;
+                    at(created).sum = at(root.node).sum;
+                    root.node = adopt(created);
+                }
+                root.level++;
+            }
+            retain(root.node);
+            return root;
+        }
+
+        // Function to get the oldest epoch announced by a reader
+        static unsigned long long oldestReader(void) {
+            atomic_thread_fence(memory_order_seq_cst); // Paired with the fence of ReadGuard, after the stores of kill
+            unsigned long long result = epoch.load();
+            for (int i = 0; i < maxReaders; i++) {
+                unsigned long long announced = slots[i].epoch.load();
+                if (announced != 0) result = min(result, announced);
+            }
+            return result;
+        }
+
+    public:
+        /*
+            * Version 0 is the empty tree, version i is the tree after the i-th insert or UpdateRange.
+            * One thread at a time can change the tree (insert, UpdateRange, retention and checkpoints, collect),
+            * while any number of threads query it with GetSum, hasVersion and getCurrentVersion without locks.
+            * The published versions are never modified, so a reader never writes to the nodes.
+        */
+        DynamicST(void) : chunks(new atomic <Version*>[maxChunks]), currentVersion(0), liveInChunk(1, 1),
+            firstVersion(0), keepLast(0), collectStep(256), slabs(new Node*[maxSlabs]()), allocated(1), freeList(0),
+            released(0), oldest(0), nodes(0) {
+            for (int i = 0; i < maxChunks; i++) chunks[i].store(nullptr, memory_order_relaxed);
+            slabs[0] = new Node[slabSize]; // Node 0 is the missing child
+            Version *first = new Version[chunkSize];
+            first[0].root = Root{0, 0}; // Initialize with a null root for version 0
+            first[0].live.store(true);
+            chunks[0].store(first);
+        }
+
+        // No reader can be inside the tree when it's destroyed
+        ~DynamicST(void) {
+            for (uint32_t i = 0; i < maxSlabs; i++) delete[] slabs[i];
+            delete[] slabs;
+            for (int i = 0; i < maxChunks; i++) delete[] chunks[i].load();
+            for (auto &chunk : retiredChunks) delete[] chunk.second;
+            delete[] chunks;
+        }
+
+        DynamicST(const DynamicST&) = delete;
+        DynamicST &operator=(const DynamicST&) = delete;
+
+        // Function to set the element at index key to value
+        void insert(Key key, long long value) {
+            TREE_RECORD(TRACE_SET, key, value);
+            TREE_TIME("dynamic_segment_tree_insert");
+            Root root = grow(key);
+            addVersion(Root{insert(root.node, 0, root.level, key, value, 0), root.level});
+            release(root.node);
+        }
+
+        // Function to add value to every element in [start, end]
+        void UpdateRange(Key start, Key end, long long value){
+            TREE_RECORD(TRACE_UPDATE, start, end, value);
+            TREE_TIME("dynamic_segment_tree_update");
+            if (start > end) {
+                addVersion(root(currentVersion.load(memory_order_relaxed))); // Empty range, same tree
+                return;
+            }
+            Root root = grow(end);
+            addVersion(Root{UpdateRange(root.node, 0, root.level, start, end, value), root.level});
+            release(root.node);
+        }
+
+        // Function to get the sum in [start, end] of the given version, by default the current one
+        long long GetSum(Key start, Key end, int version = -1) const {
+            if (version == -1) { TREE_RECORD(TRACE_SUM, start, end); }
+            else { TREE_RECORD(TRACE_VERSION_SUM, version, start, end); }
+            TREE_TIME("dynamic_segment_tree_getsum");
+            ReadGuard guard; // The nodes of the version are not freed until the guard ends
+            if (version == -1) version = currentVersion.load(memory_order_acquire); // Use the current version if not specified
+            Root node = root(version); // A released version throws out_of_range
+            if (start > end || (node.level < 64 && start >= length(node.level))) return 0; // Only zeros after the root
+            return GetSum(node.node, 0, node.level, start, end, 0);
+        }
+
+        int getCurrentVersion(void) const {
+            return currentVersion.load(memory_order_acquire);
+        }
+
+        // Function to check if a version can be queried
+        bool hasVersion(int version) const {
+            ReadGuard guard;
+            return find(version) != nullptr;
+        }
+
+        /*
+            * Function to keep only the last keepLast versions (0 keeps all of them) and the checkpoints.
+            * The older versions are released now, their nodes are freed by collect: step nodes after every
+            * operation, which must be more than the nodes created by an operation for the garbage to shrink.
+        */
+        void setRetention(int keepLast, size_t step = 256) {
+            this->keepLast = max(keepLast, 0);
+            collectStep = step;
+            trim();
+            retire();
+        }
+
+        // Function to keep a version also when it's out of the retention window
+        void checkpoint(int version) {
+            root(version); // Throws out_of_range if the version is released
+            checkpoints.insert(version);
+        }
+
+        // Function to remove a checkpoint, the version is released if it's out of the retention window
+        void releaseCheckpoint(int version) {
+            if (!checkpoints.erase(version)) return;
+            if (version < firstVersion) {
+                kill(version);
+                retire();
+            }
+        }
+
+        /*
+            * Function to free at most budget nodes without references, it returns the number of freed nodes.
+            * A node is freed only when the readers that could walk it have finished, so with long readers
+            * the garbage waits for them.
+        */
+        size_t collect(size_t budget) {
+            // The oldest reader is read again only when the waiting entries are not older, it reads every slot
+            bool refreshed = false;
+            auto expired = [&](unsigned long long released) {
+                if (released < oldest) return true;
+                if (refreshed) return false;
+                oldest = oldestReader();
+                refreshed = true;
+                return released < oldest;
+            };
+
+            size_t chunksFreed = 0;
+            while (chunksFreed < retiredChunks.size() && expired(retiredChunks[chunksFreed].first)) delete[] retiredChunks[chunksFreed++].second;
+            retiredChunks.erase(retiredChunks.begin(), retiredChunks.begin() + chunksFreed);
+
+            // The epochs in garbage don't decrease, the released children get the epoch of the last retire
+            size_t freed = 0;
+            while (freed < budget && !garbage.empty() && expired(garbage.front().first)) {
+                uint32_t index = garbage.front().second;
+                garbage.pop_front();
+                if (!at(index).leaf) {
+                    release(at(index).child[0]);
+                    release(at(index).child[1]);
+                }
+                recycle(index);
+                freed++;
+            }
+            return freed;
+        }
+
+        // Number of nodes without references that are not freed yet
+        size_t pendingGarbage(void) const {
+            return garbage.size();
+        }
+
+        // Number of nodes not freed, every update creates O(log n) of them
+        size_t nodeCount(void) const {
+            return nodes;
+        }
+
+        size_t memoryUsage(void) const {
+            size_t liveChunks = 0;
+            for (int count : liveInChunk) liveChunks += count > 0;
+            return ((allocated + slabSize - 1) / slabSize) * slabSize * sizeof(Node) + maxSlabs * sizeof(Node*) +
+                (liveChunks + retiredChunks.size()) * chunkSize * sizeof(Version) + maxChunks * sizeof(atomic <Version*>) +
+                garbage.size() * sizeof(garbage.front());
+        }
+};
+
+DynamicST::Slot DynamicST::slots[DynamicST::maxReaders];
+atomic <unsigned long long> DynamicST::epoch(1);
+
+// Create versions with random updates in [0, size) and measure the memory and the historical queries
+void benchmarkVersions(Key size, int versions) {
+    mt19937_64 rng(42);
+    DynamicST tree;
+
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < versions; i++) {
+        Key start = rng() % size;
+        Key end = start + rng() % (size - start);
+        if (i % 4 == 0) tree.insert(start, rng() % 100);
+        else tree.UpdateRange(start, end, (long long)(rng() % 7) - 3);
+    }
+    auto updated = chrono::steady_clock::now();
+
+    long long checksum = 0;
+    for (int i = 0; i < versions; i++) {
+        Key start = rng() % size;
+        checksum += tree.GetSum(start, start + rng() % (size - start), rng() % (versions + 1));
+    }
+    auto queried = chrono::steady_clock::now();
+
+    cout << "size = " << size << ", versions = " << versions << endl;
+    cout << "  updates: " << chrono::duration<double>(updated - begin).count()
+         << " s, historical queries: " << chrono::duration<double>(queried - updated).count() << " s, checksum " << checksum << endl;
+    cout << "  nodes: " << tree.nodeCount() << " (" << (double)tree.nodeCount() / versions << " per version), memory "
+         << tree.memoryUsage() / 1048576.0 << " MB (" << (double)tree.memoryUsage() / versions << " bytes per version)" << endl;
+}
+
+// Insert random 64 bit keys keeping only the current version, and measure the memory per key
+void benchmarkSparse(int keys) {
+    mt19937_64 rng(7);
+    DynamicST tree;
+    tree.setRetention(1);
+
+    vector <pair <Key, long long>> inserted(keys);
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < keys; i++) {
+        inserted[i] = make_pair(rng(), (long long)(rng() % 1000));
+        tree.insert(inserted[i].first, inserted[i].second);
+    }
+    auto built = chrono::steady_clock::now();
+
+    sort(inserted.begin(), inserted.end());
+    vector <long long> prefix(keys + 1, 0);
+    for (int i = 0; i < keys; i++) prefix[i + 1] = prefix[i] + inserted[i].second;
+    int errors = 0;
+    auto checked = chrono::steady_clock::now();
+    for (int i = 0; i < 100000; i++) {
+        Key start = rng(), end = rng();
+        if (start > end) swap(start, end);
+        size_t first = lower_bound(inserted.begin(), inserted.end(), make_pair(start, LLONG_MIN)) - inserted.begin();
+        size_t last = upper_bound(inserted.begin(), inserted.end(), make_pair(end, LLONG_MAX)) - inserted.begin();
+        if (tree.GetSum(start, end) != prefix[last] - prefix[first]) errors++;
+    }
+    auto queried = chrono::steady_clock::now();
+
+    cout << "keys = " << keys << endl;
+    cout << "  inserts: " << chrono::duration<double>(built - begin).count() << " s, 1e5 range sums: "
+         << chrono::duration<double>(queried - checked).count() << " s, " << (errors == 0 ? "same sums" : "DIFFERENT SUMS") << endl;
+    cout << "  nodes: " << tree.nodeCount() << " (" << (double)tree.nodeCount() / keys << " per key), memory "
+         << tree.memoryUsage() / 1048576.0 << " MB (" << (double)tree.memoryUsage() / keys << " bytes per key)" << endl;
+}
+
+// Run many operations keeping the last versions and a checkpoint every 10000 versions
+void benchmarkRetention(Key size, int versions, int keepLast) {
+    mt19937_64 rng(42);
+    DynamicST tree;
+    tree.setRetention(keepLast);
+
+    size_t peakNodes = 0;
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < versions; i++) {
+        Key start = rng() % size;
+        Key end = start + rng() % (size - start);
+        if (i % 4 == 0) tree.insert(start, rng() % 100);
+        else tree.UpdateRange(start, end, (long long)(rng() % 7) - 3);
+        if (tree.getCurrentVersion() % 10000 == 0) tree.checkpoint(tree.getCurrentVersion());
+        peakNodes = max(peakNodes, tree.nodeCount());
+    }
+    auto updated = chrono::steady_clock::now();
+
+    cout << "size = " << size << ", versions = " << versions << ", keep last " << keepLast << " and every 10000th" << endl;
+    cout << "  updates with collection: " << chrono::duration<double>(updated - begin).count()
+         << " s, live nodes " << tree.nodeCount() << " (peak " << peakNodes << "), garbage " << tree.pendingGarbage()
+         << ", memory " << tree.memoryUsage() / 1048576.0 << " MB" << endl;
+}
+
+/*
+    * One writer creates versions while the readers query random recent versions and the checkpoints.
+    * The writer only adds to ranges of fresh random keys, so the sum of all the keys of version v is known
+    * before the test; a reader must get it for every version it finds, and it can miss only the released ones.
+*/
+bool benchmarkReaders(int readers, int versions) {
+    const int keepLast = 1000;
+    mt19937_64 rng(5);
+    vector <Key> starts(versions + 1);
+    vector <long long> total(versions + 1, 0);
+    for (int v = 1; v <= versions; v++) {
+        starts[v] = rng();
+        total[v] = total[v - 1] + (v % 8 + 1) * (long long)(v % 5 + 1);
+    }
+
+    DynamicST tree;
+    tree.setRetention(keepLast);
+    atomic <bool> stop(false);
+    atomic <long long> errors(0), queries(0), missed(0);
+    vector <thread> threads;
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r]() {
+            mt19937_64 local(100 + r);
+            long long done = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                int current = tree.getCurrentVersion();
+                int version = local() % 4 ? current - (int)(local() % (keepLast + 500)) : (int)(local() % (current / 10000 + 1)) * 10000;
+                if (version <= 0) continue; // Version 0 is not a checkpoint
+                try {
+                    long long left = tree.GetSum(0, (1ULL << 63) - 1, version), right = tree.GetSum(1ULL << 63, UINT64_MAX, version);
+                    if (left + right != total[version]) errors++;
+                } catch (out_of_range&) {
+                    // Released versions are out of the window when the reader asks and not checkpoints
+                    if (version % 10000 == 0 || version > tree.getCurrentVersion() - keepLast) errors++;
+                    missed++;
+                }
+                done++;
+            }
+            queries += done;
+        });
+    }
+
+    auto begin = chrono::steady_clock::now();
+    for (int v = 1; v <= versions; v++) {
+        Key length = v % 8 + 1;
+        Key start = min(starts[v], UINT64_MAX - length);
+        tree.UpdateRange(start, start + length - 1, v % 5 + 1);
+        if (v % 10000 == 0) tree.checkpoint(v);
+    }
+    auto written = chrono::steady_clock::now();
+    stop = true;
+    for (thread &t : threads) t.join();
+
+    double seconds = chrono::duration<double>(written - begin).count();
+    cout << "1 writer and " << readers << " readers, " << versions << " versions: "
+         << (errors == 0 ? "passed" : "FAILED") << " (" << errors << " errors)" << endl;
+    cout << "  writes: " << versions / seconds / 1e6 << " M/s, reads: " << queries / seconds / 1e6 << " M/s ("
+         << missed << " released versions), live nodes " << tree.nodeCount() << ", garbage " << tree.pendingGarbage() << endl;
+    return errors == 0;
+}
+
+/*
+    You can use this dynamic segment tree to perform operations like inserting values,
+    updating ranges, and querying sums efficiently. you can create multiple versions of the segment tree
+    to keep track of historical changes, allowing you to query the state of the segment tree at any previous version.
+    This implementation supports lazy propagation for efficient range updates.
+    You acn also modify the code to support more complex operations like range minimum queries, range maximum queries, etc.
+    You can insert nested structures or additional variables in the Node structure to store more information,
+    such as the number of elements in the segment, which can be useful for other operations.
+*/
+
+// Workload of the shared suite: n inserts of keys of [0, 4n) keeping only the current version, then the
+// queries are GetSum on the current version and the updates are inserts and UpdateRange
+void suiteWorkload(const Workload &workload) {
+    uint64_t n = workload.size;
+    KeyGenerator keys(workload.distribution, 4 * n, workload.seed());
+    vector <Key> inserted(n);
+    for (Key &key : inserted) key = keys.next();
+    vector <Key> distinct(inserted);
+    sort(distinct.begin(), distinct.end());
+    size_t elements = unique(distinct.begin(), distinct.end()) - distinct.begin();
+    vector <Key>().swap(distinct);
+    BenchmarkRun run("dynamic_segment_tree", workload);
+
+    run.startBuild();
+    DynamicST tree;
+    tree.setRetention(1);
+    for (uint64_t i = 0; i < n; i++) tree.insert(inserted[i], (long long)(inserted[i] % 100));
+    run.endBuild(elements);
+
+    bool point = false;
+    run.run(4 * n, [&](bool read, uint64_t key, uint64_t other) -> long long {
+        Key start = min(key, other), end = max(key, other);
+        if (read) return tree.GetSum(start, end);
+        point = !point; // Half of the updates set a key, the other half add to a range
+        if (point) tree.insert(key, (long long)(other % 100));
+        else tree.UpdateRange(start, end, key & 1 ? 1 : -1);
+        return 0;
+    });
+}
+
+/*
+    * Replay a trace on a DynamicST. The blocks and the appends of an array (a static segment tree or a
+    * VectorTree) become inserts at the next indices, one version each, so the versions of a trace
+    * recorded on a VectorTree don't match, but the sums of the newest version do.
+*/
+bool replay(const string &path) {
+    DynamicST tree;
+    Key next = 0; // Index of the next appended value
+    vector <int> values;
+    return replayTrace(path, "dynamic", [&](const TraceRecord &record) -> long long {
+        const int64_t *arguments = record.arguments;
+        switch (record.operation) {
+            case TRACE_BLOCK:
+                TraceReader::values(record, values);
+                for (int value : values) tree.insert(next++, value);
+                return 0;
+            case TRACE_APPEND: tree.insert(next++, arguments[0]); return 0;
+            case TRACE_SET: tree.insert(arguments[0], arguments[1]); return 0;
+            case TRACE_UPDATE: tree.UpdateRange(arguments[0], arguments[1], arguments[2]); return 0;
+            case TRACE_SUM: return (int)tree.GetSum(arguments[0], arguments[1]); // Same overflow of the int trees
+            case TRACE_VERSION_SUM: return (int)tree.GetSum(arguments[1], arguments[2], (int)arguments[0]);
+            default: throw unsupported(record);
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        // ./Dynamic_Segment_tree bench [size] [versions]
+        Key size = argc > 2 ? stoull(argv[2]) : 1000000;
+        int versions = argc > 3 ? stoi(argv[3]) : 1000000;
+        benchmarkVersions(size, versions);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "retention") {
+        // ./Dynamic_Segment_tree retention [size] [versions] [keep last]
+        Key size = argc > 2 ? stoull(argv[2]) : 1000000;
+        int versions = argc > 3 ? stoi(argv[3]) : 1000000;
+        int keepLast = argc > 4 ? stoi(argv[4]) : 1000;
+        benchmarkRetention(size, versions, keepLast);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "sparse") {
+        // ./Dynamic_Segment_tree sparse [keys]
+        benchmarkSparse(argc > 2 ? stoi(argv[2]) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "suite") {
+        // ./Dynamic_Segment_tree suite [sizes...], one JSON line for every workload
+        return runSuite("dynamic_segment_tree", suiteSizes(argc, argv, 2), suiteWorkload) ? 0 : 1;
+    }
+    if (argc > 2 && string(argv[1]) == "replay") {
+        // ./Dynamic_Segment_tree replay <trace>
+        return replay(argv[2]) ? 0 : 1;
+    }
+
+    if (argc > 1 && string(argv[1]) == "readers") {
+        // ./Dynamic_Segment_tree readers [versions] [readers...]
+        int versions = argc > 2 ? stoi(argv[2]) : 1000000;
+        bool passed = true;
+        if (argc > 3) {
+            for (int i = 3; i < argc; i++) passed = benchmarkReaders(stoi(argv[i]), versions) && passed;
+        } else {
+            for (int readers : {1, 2, 4, 8}) passed = benchmarkReaders(readers, versions) && passed;
+        }
+        return passed ? 0 : 1;
+    }
+
+    DynamicST segTree; // Create a dynamic segment tree over [0, 2^64)
+
+    segTree.insert(1, 5); // Insert value 5 at index 1
+    segTree.insert(2, 10); // Insert value 10 at index 2
+    segTree.UpdateRange(1, 2, 3); // Update range [1, 2] by adding 3
+
+    cout << "Sum from index 1 to 2: " << segTree.GetSum(1, 2) << endl; // Should output 21 (5 + 10 + 3)
+    cout << "Sum from index 1 to 2 in version 2: " << segTree.GetSum(1, 2, 2) << endl; // Should output 15, before the update
+
+    segTree.insert(18000000000000000000ULL, 7); // Any 64 bit key
+    cout << "Sum of all the keys: " << segTree.GetSum(0, UINT64_MAX) << endl; // Should output 28
+
+    segTree.checkpoint(2); // Keep version 2
+    segTree.setRetention(1); // Keep only the current version and the checkpoints
+    cout << "Version 1 is " << (segTree.hasVersion(1) ? "kept" : "released") << endl; // Should output released
+
+    TREE_STATS_DUMP(cout); // Counters of the example, only with -DTREE_STATS
+
+    return 0;
+}
@@ -0,0 +1,437 @@
+#include<iostream>
+#include<algorithm>
+#include<vector>
+#include<limits>
+#include<random>
+#include<chrono>
+#include<string>
+using namespace std;
+
+/*
+    * This file implements a generic segment tree with lazy propagation: SegmentTree<Monoid, LazyTag>.
+    * The Monoid says how two segments are combined (sum, minimum, maximum), the LazyTag says which
+    * updates are applied to a range (add, affine x -> a * x + b that includes assign) and how two of them are composed.
+    * Both are classes with static functions, so the compiler resolves and inlines them: the tree
+    * is as fast as one written by hand for a single operation.
+    * The values are long long by default, so sums don't overflow at large sizes.
+    * With LazyTag = NoLazy the tree supports only point updates and has no tags and no push.
+*/
+
+// Monoids: identity() is the value of an empty segment, combine() joins two adjacent segments,
+// repeat(x, length) is the value of a segment with length elements equal to x
+
+template <class T = long long>
+struct Sum {
+    typedef T Value;
+    static Value identity(void) { return 0; }
+    static Value combine(const Value &a, const Value &b) { return a + b; }
+    static Value repeat(const Value &x, int length) { return x * length; }
+};
+
+template <class T = long long>
+struct Min {
+    typedef T Value;
+    static Value identity(void) { return numeric_limits<T>::max(); }
+    static Value combine(const Value &a, const Value &b) { return min(a, b); }
+    static Value repeat(const Value &x, int) { return x; }
+};
+
+template <class T = long long>
+struct Max {
+    typedef T Value;
+    static Value identity(void) { return numeric_limits<T>::lowest(); }
+    static Value combine(const Value &a, const Value &b) { return max(a, b); }
+    static Value repeat(const Value &x, int) { return x; }
+};
+
+// Lazy tags: identity() changes nothing, compose(newer, older) is the tag that applies older and then newer,
+// apply<Monoid>(tag, value, length) is the value of a segment with length elements after the tag
+
+// Add a value to every element
+template <class T = long long>
+struct Add {
+    typedef T Tag;
+    static Tag identity(void) { return 0; }
+    static bool empty(const Tag &tag) { return tag == 0; }
+    static Tag compose(const Tag &newer, const Tag &older) { return newer + older; }
+
+    template <class Monoid>
+    static typename Monoid::Value apply(const Tag &tag, const typename Monoid::Value &value, int length) {
+        return value + Monoid::repeat(tag, length);
+    }
+};
+
+// Replace every element x with multiply * x + add: assign c is {0, c}, add c is {1, c}.
+// With Min and Max multiply must not be negative, otherwise the order of the elements changes.
+template <class T = long long>
+struct Affine {
+    struct Tag {
+        T multiply, add;
+    };
+    static Tag identity(void) { return Tag{1, 0}; }
+    static Tag assign(const T &value) { return Tag{0, value}; }
+    static Tag increase(const T &value) { return Tag{1, value}; }
+    static bool empty(const Tag &tag) { return tag.multiply == 1 && tag.add == 0; }
+    static Tag compose(const Tag &newer, const Tag &older) {
+        return Tag{newer.multiply * older.multiply, newer.multiply * older.add + newer.add};
+    }
+
+    template <class Monoid>
+    static typename Monoid::Value apply(const Tag &tag, const typename Monoid::Value &value, int length) {
+        return tag.multiply * value + Monoid::repeat(tag.add, length);
+    }
+};
+
+// No range updates: SegmentTree<Monoid, NoLazy> is the specialization without tags
+struct NoLazy {};
+
+/*
+    * SegmentTree stores the tree in arrays like FlatSegmentTree: the root is at position 1, the children
+    * of position i are 2i and 2i + 1 and the leaf of element i is at position leaves + i.
+    * The number of leaves is rounded up to a power of 2, the extra leaves contain Monoid::identity()
+    * and the tags are never applied to them, so the length passed to apply is the number of real elements.
+    * Updates and queries push the tags of the ancestors of the two ends of the range and then
+    * go from the leaves to the root, so the operations are iterative.
+    * Ranges are inclusive and clamped to the elements of the tree.
+*/
+template <class Monoid, class LazyTag>
+class SegmentTree {
+    public:
+        typedef typename Monoid::Value Value;
+        typedef typename LazyTag::Tag Tag;
+
+    private:
+        int n; // Number of elements
+        int leaves; // Number of leaves (power of 2)
+        int levels; // Height of the tree, leaves = 2^levels
+        vector <Value> value; // Value of the segment of every node, with its own tag already applied
+        vector <Tag> tag; // Tag of every internal node, not yet applied to its children
+
+        // Number of elements of the tree in the segment of node, the node is at level (0 for the leaves)
+        int length(int node, int level) const {
+            int start = (node << level) - leaves;
+            return min(1 << level, n - start);
+        }
+
+        void apply(int node, int level, const Tag &update) {
+            int count = length(node, level);
+            if (count <= 0) return; // Only extra leaves
+            value[node] = LazyTag::template apply<Monoid>(update, value[node], count);
+            if (node < leaves) tag[node] = LazyTag::compose(update, tag[node]);
+        }
+
+        void push(int node, int level) {
+            if (LazyTag::empty(tag[node])) return;
+            apply(2 * node, level - 1, tag[node]);
+            apply(2 * node + 1, level - 1, tag[node]);
+            tag[node] = LazyTag::identity();
+        }
+
+        void pull(int node) {
+            value[node] = Monoid::combine(value[2 * node], value[2 * node + 1]);
+        }
+
+        // Function to push the tags of the ancestors of the half open range [l, r) of leaves, from the root down
+        void pushAncestors(int l, int r) {
+            for (int level = levels; level >= 1; level--) {
+                if (((l >> level) << level) != l) push(l >> level, level);
+                if (((r >> level) << level) != r) push((r - 1) >> level, level);
+            }
+        }
+
+        bool clamp(int &start, int &end) const {
+            start = max(start, 0);
+            end = min(end, n - 1);
+            return start <= end;
+        }
+
+    public:
+        SegmentTree(void) : n(0), leaves(1), levels(0), value(2, Monoid::identity()), tag(1, LazyTag::identity()) {}
+
+        template <class Element>
+        SegmentTree(const vector <Element> &arr) : SegmentTree() {
+            build(arr);
+        }
+
+        // Function to build the segment tree from the given array in O(n)
+        template <class Element>
+        void build(const vector <Element> &arr) {
+            n = arr.size();
+            leaves = 1;
+            levels = 0;
+            while (leaves < n) {
+                leaves *= 2;
+                levels++;
+            }
+
+            value.assign(2 * leaves, Monoid::identity());
+            tag.assign(leaves, LazyTag::identity());
+            for (int i = 0; i < n; i++) value[leaves + i] = Value(arr[i]);
+            for (int node = leaves - 1; node > 0; node--) pull(node);
+        }
+
+        // Function to apply update to every element in [start, end]
+        void UpdateRange(int start, int end, const Tag &update) {
+            if (!clamp(start, end)) return; // Out of range
+            int l = start + leaves, r = end + leaves + 1;
+            pushAncestors(l, r);
+
+            // Nodes that cover [start, end] exactly, from the leaves up
+            for (int first = l, last = r, level = 0; first < last; first /= 2, last /= 2, level++) {
+                if (first & 1) apply(first++, level, update);
+                if (last & 1) apply(--last, level, update);
+            }
+
+            // Their ancestors are the ancestors of the first and of the last leaf
+            for (int level = 1; level <= levels; level++) {
+                if (((l >> level) << level) != l) pull(l >> level);
+                if (((r >> level) << level) != r) pull((r - 1) >> level);
+            }
+        }
+
+        // Function to get the combination of the elements in [start, end], left to right
+        Value GetRange(int start, int end) {
+            if (!clamp(start, end)) return Monoid::identity(); // Out of range
+            int l = start + leaves, r = end + leaves + 1;
+            pushAncestors(l, r);
+
+            Value left = Monoid::identity(), right = Monoid::identity();
+            for (; l < r; l /= 2, r /= 2) {
+                if (l & 1) left = Monoid::combine(left, value[l++]);
+                if (r & 1) right = Monoid::combine(value[--r], right);
+            }
+            return Monoid::combine(left, right);
+        }
+
+        int size(void) const {
+            return n;
+        }
+
+        size_t memoryUsage(void) const {
+            return value.size() * sizeof(Value) + tag.size() * sizeof(Tag);
+        }
+};
+
+/*
+    * Specialization without lazy tags: there is nothing to push, an update changes one element
+    * and recomputes its ancestors, a query only reads the array.
+*/
+template <class Monoid>
+class SegmentTree<Monoid, NoLazy> {
+    public:
+        typedef typename Monoid::Value Value;
+
+    private:
+        int n; // Number of elements
+        int leaves; // Number of leaves (power of 2)
+        vector <Value> value; // Value of the segment of every node
+
+    public:
+        SegmentTree(void) : n(0), leaves(1), value(2, Monoid::identity()) {}
+
+        template <class Element>
+        SegmentTree(const vector <Element> &arr) : SegmentTree() {
+            build(arr);
+        }
+
+        // Function to build the segment tree from the given array in O(n)
+        template <class Element>
+        void build(const vector <Element> &arr) {
+            n = arr.size();
+            leaves = 1;
+            while (leaves < n) leaves *= 2;
+
+            value.assign(2 * leaves, Monoid::identity());
+            for (int i = 0; i < n; i++) value[leaves + i] = Value(arr[i]);
+            for (int node = leaves - 1; node > 0; node--) {
+                value[node] = Monoid::combine(value[2 * node], value[2 * node + 1]);
+            }
+        }
+
+        // Function to replace the element at index with x
+        void Set(int index, const Value &x) {
+            if (index < 0 || index >= n) return; // Out of range
+            int node = index + leaves;
+            value[node] = x;
+            for (node /= 2; node > 0; node /= 2) {
+                value[node] = Monoid::combine(value[2 * node], value[2 * node + 1]);
+            }
+        }
+
+        // Function to get the combination of the elements in [start, end], left to right
+        Value GetRange(int start, int end) const {
+            start = max(start, 0);
+            end = min(end, n - 1);
+            if (start > end) return Monoid::identity(); // Out of range
+
+            Value left = Monoid::identity(), right = Monoid::identity();
+            for (int l = start + leaves, r = end + leaves + 1; l < r; l /= 2, r /= 2) {
+                if (l & 1) left = Monoid::combine(left, value[l++]);
+                if (r & 1) right = Monoid::combine(value[--r], right);
+            }
+            return Monoid::combine(left, right);
+        }
+
+        int size(void) const {
+            return n;
+        }
+
+        size_t memoryUsage(void) const {
+            return value.size() * sizeof(Value);
+        }
+};
+
+/*
+    * IntSumTree is the same tree written by hand for int sums and additions,
+    * used by the benchmark to measure the cost of the template.
+*/
+class IntSumTree {
+    private:
+        int n, leaves, levels;
+        vector <int> sum, update;
+
+        void apply(int node, int level, int add) {
+            int count = min(1 << level, n - ((node << level) - leaves));
+            if (count <= 0) return;
+            sum[node] += add * count;
+            if (node < leaves) update[node] += add;
+        }
+
+        void push(int node, int level) {
+            if (update[node] == 0) return;
+            apply(2 * node, level - 1, update[node]);
+            apply(2 * node + 1, level - 1, update[node]);
+            update[node] = 0;
+        }
+
+        void pushAncestors(int l, int r) {
+            for (int level = levels; level >= 1; level--) {
+                if (((l >> level) << level) != l) push(l >> level, level);
+                if (((r >> level) << level) != r) push((r - 1) >> level, level);
+            }
+        }
+
+    public:
+        IntSumTree(const vector <int> &arr) : n(arr.size()), leaves(1), levels(0) {
+            while (leaves < n) {
+                leaves *= 2;
+                levels++;
+            }
+            sum.assign(2 * leaves, 0);
+            update.assign(leaves, 0);
+            copy(arr.begin(), arr.end(), sum.begin() + leaves);
+            for (int node = leaves - 1; node > 0; node--) sum[node] = sum[2 * node] + sum[2 * node + 1];
+        }
+
+        void UpdateRange(int start, int end, int add) {
+            start = max(start, 0);
+            end = min(end, n - 1);
+            if (start > end) return;
+            int l = start + leaves, r = end + leaves + 1;
+            pushAncestors(l, r);
+            for (int first = l, last = r, level = 0; first < last; first /= 2, last /= 2, level++) {
+                if (first & 1) apply(first++, level, add);
+                if (last & 1) apply(--last, level, add);
+            }
+            for (int level = 1; level <= levels; level++) {
+                if (((l >> level) << level) != l) sum[l >> level] = sum[2 * (l >> level)] + sum[2 * (l >> level) + 1];
+                if (((r >> level) << level) != r) sum[(r - 1) >> level] = sum[2 * ((r - 1) >> level)] + sum[2 * ((r - 1) >> level) + 1];
+            }
+        }
+
+        int GetSum(int start, int end) {
+            start = max(start, 0);
+            end = min(end, n - 1);
+            if (start > end) return 0;
+            int l = start + leaves, r = end + leaves + 1;
+            pushAncestors(l, r);
+            int result = 0;
+            for (; l < r; l /= 2, r /= 2) {
+                if (l & 1) result += sum[l++];
+                if (r & 1) result += sum[--r];
+            }
+            return result;
+        }
+
+        size_t memoryUsage(void) const {
+            return (sum.size() + update.size()) * sizeof(int);
+        }
+};
+
+// Function to run the same operations on a tree and to print the times, checksum is the sum of the queries
+template <class Tree>
+void benchmarkTree(const string &name, Tree &tree, const vector <int> &starts, const vector <int> &ends) {
+    int operations = starts.size();
+    long long checksum = 0;
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) tree.UpdateRange(starts[i], ends[i], i % 7 - 3);
+    auto updated = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) checksum += tree.GetSum(starts[operations - 1 - i], ends[operations - 1 - i]);
+    auto queried = chrono::steady_clock::now();
+    cout << "  " << name << ": updates " << chrono::duration<double>(updated - begin).count()
+         << " s, queries " << chrono::duration<double>(queried - updated).count()
+         << " s, memory " << tree.memoryUsage() / 1048576.0 << " MB, checksum " << checksum << endl;
+}
+
+// Adapter with the names of IntSumTree
+template <class Monoid, class LazyTag>
+struct SumAdapter : SegmentTree<Monoid, LazyTag> {
+    SumAdapter(const vector <int> &arr) : SegmentTree<Monoid, LazyTag>(arr) {}
+    typename Monoid::Value GetSum(int start, int end) { return this->GetRange(start, end); }
+};
+
+// Hand written int tree against the template with int and with long long values
+void benchmarkGeneric(int n, int operations) {
+    mt19937 rng(42);
+    vector <int> arr(n);
+    for (int &value : arr) value = rng() % 100;
+    vector <int> starts(operations), ends(operations);
+    for (int i = 0; i < operations; i++) {
+        starts[i] = rng() % n;
+        ends[i] = starts[i] + rng() % (n - starts[i]);
+    }
+
+    cout << "n = " << n << endl;
+    IntSumTree manual(arr);
+    benchmarkTree("hand written int      ", manual, starts, ends);
+    SumAdapter<Sum<int>, Add<int>> generic(arr);
+    benchmarkTree("SegmentTree<int>      ", generic, starts, ends);
+    SumAdapter<Sum<long long>, Add<long long>> wide(arr);
+    benchmarkTree("SegmentTree<long long>", wide, starts, ends);
+}
+
+/*
+you can use this segment tree with any monoid and lazy tag that have the static functions above,
+for example the number of elements greater than zero, or the sum of squares with an Add tag
+(a segment needs its sum and its sum of squares in Value).
+*/
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        vector <int> sizes;
+        for (int i = 2; i < argc; i++) sizes.push_back(stoi(argv[i]));
+        if (sizes.empty()) sizes = {1000000, 10000000};
+        for (int n : sizes) benchmarkGeneric(n, 1000000);
+        return 0;
+    }
+
+    vector<int> arr = {1, 2, 3, 4, 5}; // Example array
+
+    SegmentTree<Sum<>, Add<>> sums(arr);
+    sums.UpdateRange(1, 3, 10); // Add 10 to [1, 3]
+    cout << "Sum of range (0, 4): " << sums.GetRange(0, 4) << endl; // Should print 45
+
+    SegmentTree<Sum<>, Add<>> large(vector<int>(5, 2000000000));
+    cout << "Sum without overflow: " << large.GetRange(0, 4) << endl; // Should print 10000000000
+
+    SegmentTree<Min<>, Affine<>> minimum(arr);
+    minimum.UpdateRange(0, 2, Affine<>::assign(7)); // {7, 7, 7, 4, 5}
+    minimum.UpdateRange(2, 4, Affine<>::increase(-3)); // {7, 7, 4, 1, 2}
+    cout << "Minimum of range (0, 2): " << minimum.GetRange(0, 2) << endl; // Should print 4
+
+    SegmentTree<Max<>, NoLazy> maximum(arr);
+    maximum.Set(0, 9);
+    cout << "Maximum of range (0, 4): " << maximum.GetRange(0, 4) << endl; // Should print 9
+
+    return 0;
+}
@@ -0,0 +1,349 @@
+#include<iostream>
+#include<algorithm>
+#include<vector>
+#include<random>
+#include<chrono>
+#include<string>
+#include<cstring>
+#include<cstdint>
+#include<stdexcept>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+using namespace std;
+
+/*
+    * This file implements a segment tree stored in a file, for arrays that don't fit in memory.
+    * The file is used with mmap: opening it only maps it, a query reads only the pages of the nodes it
+    * visits, and several processes that open the same file share one copy of it in the page cache.
+    * The layout is the one of FlatSegmentTree with 64 bit values:
+    *
+    *   page 0:          MappedHeader (magic, version, number of elements, offsets of the arrays)
+    *   sumOffset:       long long sum[2 * leaves]   sum of the segment of every node, with its own lazy value
+    *   updateOffset:    long long update[leaves]    lazy value of every internal node
+    *
+    * The root is at position 1, the children of position i are 2i and 2i + 1, so the top levels of the tree
+    * are in the first pages and the leaves are contiguous. Both arrays start on a page boundary.
+    * The lazy values are never pushed: a query adds the lazy values of the partially covered ancestors,
+    * so queries never write and the read only mapping can be shared.
+    * Range updates are possible when the file is opened in WRITE_BACK mode: they write to a shared
+    * mapping and flush() saves them to the file.
+*/
+
+const size_t pageSize = 4096; // Alignment of the arrays in the file
+const char mappedMagic[8] = {'S', 'E', 'G', 'T', 'R', 'E', 'E', '1'};
+const uint32_t mappedVersion = 1;
+
+struct MappedHeader { // Structure of the first page of the file
+    char magic[8];
+    uint32_t version;
+    uint32_t levels; // Height of the tree, leaves = 2^levels
+    uint64_t n; // Number of elements
+    uint64_t leaves; // Number of leaves (power of 2), the leaf of element i is at position leaves + i
+    uint64_t sumOffset, updateOffset; // Positions of the arrays in the file
+    uint64_t fileSize;
+};
+
+// Function to round size up to a multiple of the page size
+size_t pageAlign(size_t size) {
+    return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+// Function to throw the error of the last system call
+void systemError(const string &what, const string &path) {
+    throw runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+class MappedSegmentTree {
+    public:
+        enum Mode { READ_ONLY, WRITE_BACK };
+
+    private:
+        int fd;
+        char *base; // Start of the mapping
+        size_t length; // Length of the mapping
+        Mode mode;
+        long long n, leaves;
+        int levels;
+        long long *sum;
+        long long *update;
+
+        // Number of elements of [start, end] inside the segment of node, or 0 if the node is completely inside
+        long long partialOverlap(long long node, int level, long long start, long long end) const {
+            long long first = (node << level) - leaves;
+            long long last = first + (1LL << level) - 1;
+            if (start <= first && last <= end) return 0;
+            return min(last, end) - max(first, start) + 1;
+        }
+
+        void apply(long long node, long long value, long long count) {
+            sum[node] += value * count;
+            if (node < leaves) update[node] += value;
+        }
+
+        void recompute(long long node, long long count) {
+            sum[node] = sum[2 * node] + sum[2 * node + 1] + update[node] * count;
+        }
+
+    public:
+        // Function to map the tree saved in path, the file must have been written by create
+        MappedSegmentTree(const string &path, Mode mode = READ_ONLY) : fd(-1), base(nullptr), length(0), mode(mode) {
+            fd = open(path.c_str(), mode == READ_ONLY ? O_RDONLY : O_RDWR);
+            if (fd < 0) systemError("cannot open", path);
+
+            struct stat info;
+            if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(MappedHeader)) {
+                close(fd);
+                throw runtime_error("not a segment tree file: " + path);
+            }
+            length = info.st_size;
+
+            int protection = mode == READ_ONLY ? PROT_READ : PROT_READ | PROT_WRITE;
+            void *mapping = mmap(nullptr, length, protection, MAP_SHARED, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                systemError("cannot map", path);
+            }
+            base = static_cast<char*>(mapping);
+
+            const MappedHeader *header = reinterpret_cast<const MappedHeader*>(base);
+            if (memcmp(header->magic, mappedMagic, sizeof(mappedMagic)) != 0 || header->version != mappedVersion
+                || header->fileSize != length || header->levels > 40 || header->leaves != (1ULL << header->levels)
+                || header->sumOffset + 2 * header->leaves * sizeof(long long) > length
+                || header->updateOffset + header->leaves * sizeof(long long) > length) {
+                munmap(base, length);
+                close(fd);
+                throw runtime_error("not a valid segment tree file: " + path);
+            }
+
+            n = header->n;
+            leaves = header->leaves;
+            levels = header->levels;
+            sum = reinterpret_cast<long long*>(base + header->sumOffset);
+            update = reinterpret_cast<long long*>(base + header->updateOffset);
+            madvise(base, length, MADV_RANDOM); // A query reads a few nodes, reading ahead would load pages not needed
+        }
+
+        ~MappedSegmentTree(void) {
+            if (mode == WRITE_BACK) msync(base, length, MS_ASYNC);
+            munmap(base, length);
+            close(fd);
+        }
+
+        MappedSegmentTree(const MappedSegmentTree&) = delete;
+        MappedSegmentTree &operator=(const MappedSegmentTree&) = delete;
+
+        /*
+            * Function to write the tree of values[0, count) to path.
+            * The tree is written through a mapping of a new file, with the internal nodes computed from the
+            * leaves level by level, so values can be a mapping of a raw file larger than the memory.
+            * The file is written as path.tmp and renamed at the end, so a reader never sees it incomplete.
+        */
+        static void create(const string &path, const int *values, long long count) {
+            MappedHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, mappedMagic, sizeof(mappedMagic));
+            header.version = mappedVersion;
+            header.n = count;
+            header.leaves = 1;
+            while (header.leaves < header.n) {
+                header.leaves *= 2;
+                header.levels++;
+            }
+            header.sumOffset = pageSize;
+            header.updateOffset = pageAlign(header.sumOffset + 2 * header.leaves * sizeof(long long));
+            header.fileSize = pageAlign(header.updateOffset + header.leaves * sizeof(long long));
+
+            string temporary = path + ".tmp";
+            int out = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (out < 0) systemError("cannot create", temporary);
+            if (ftruncate(out, header.fileSize) < 0) { // The new pages read as 0: the lazy values and the extra leaves
+                close(out);
+                systemError("cannot resize", temporary);
+            }
+            void *mapping = mmap(nullptr, header.fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, out, 0);
+            if (mapping == MAP_FAILED) {
+                close(out);
+                systemError("cannot map", temporary);
+            }
+            char *file = static_cast<char*>(mapping);
+            madvise(file, header.fileSize, MADV_SEQUENTIAL);
+
+            memcpy(file, &header, sizeof(header));
+            long long *tree = reinterpret_cast<long long*>(file + header.sumOffset);
+            long long leaves = header.leaves;
+            for (long long i = 0; i < count; i++) tree[leaves + i] = values[i];
+            for (long long node = leaves - 1; node > 0; node--) tree[node] = tree[2 * node] + tree[2 * node + 1];
+
+            bool saved = msync(file, header.fileSize, MS_SYNC) == 0;
+            munmap(file, header.fileSize);
+            close(out);
+            if (!saved) systemError("cannot write", temporary);
+            if (rename(temporary.c_str(), path.c_str()) < 0) systemError("cannot rename", temporary);
+        }
+
+        // Overloaded function to write the tree of the given array
+        static void create(const string &path, const vector <int> &arr) {
+            create(path, arr.data(), arr.size());
+        }
+
+        // Function to get the sum in [start, end], it only reads the mapping
+        long long GetSum(long long start, long long end) const {
+            start = max(start, 0LL);
+            end = min(end, n - 1);
+            if (start > end) return 0; // Out of range
+
+            long long result = 0;
+            for (long long l = start + leaves, r = end + leaves + 1; l < r; l /= 2, r /= 2) {
+                if (l & 1) result += sum[l++];
+                if (r & 1) result += sum[--r];
+            }
+
+            // Lazy values of the ancestors that contain only a part of [start, end]
+            for (int level = 1; level <= levels; level++) {
+                long long first = (start + leaves) >> level, last = (end + leaves) >> level;
+                if (update[first] != 0) result += update[first] * partialOverlap(first, level, start, end);
+                if (last != first && update[last] != 0) result += update[last] * partialOverlap(last, level, start, end);
+            }
+
+            return result;
+        }
+
+        // Function to add value to every element in [start, end], only in WRITE_BACK mode
+        void UpdateRange(long long start, long long end, long long value) {
+            if (mode != WRITE_BACK) throw logic_error("UpdateRange on a read only segment tree");
+            start = max(start, 0LL);
+            end = min(end, n - 1);
+            if (start > end) return; // Out of range
+
+            // Nodes that cover [start, end] exactly, from the leaves up
+            long long count = 1;
+            for (long long l = start + leaves, r = end + leaves + 1; l < r; l /= 2, r /= 2, count *= 2) {
+                if (l & 1) apply(l++, value, count);
+                if (r & 1) apply(--r, value, count);
+            }
+
+            // Their ancestors are the ancestors of the first and of the last leaf
+            count = 2;
+            for (int level = 1; level <= levels; level++, count *= 2) {
+                long long first = (start + leaves) >> level, last = (end + leaves) >> level;
+                recompute(first, count);
+                if (last != first) recompute(last, count);
+            }
+        }
+
+        // Function to write the updates to the file before returning
+        void flush(void) {
+            if (mode == WRITE_BACK && msync(base, length, MS_SYNC) < 0) {
+                throw runtime_error(string("cannot write the segment tree: ") + strerror(errno));
+            }
+        }
+
+        long long size(void) const {
+            return n;
+        }
+
+        size_t fileSize(void) const {
+            return length;
+        }
+};
+
+// Function to get the sum in [start, end] from the prefix sums, used to check the results
+long long prefixSum(const vector <long long> &prefix, long long start, long long end) {
+    start = max(start, 0LL);
+    end = min(end, (long long)prefix.size() - 2);
+    return start > end ? 0 : prefix[end + 1] - prefix[start];
+}
+
+// Create, open, query and update a tree in a file, checking the sums with prefix sums
+void benchmarkMapped(int n, int operations, const string &path) {
+    mt19937 rng(42);
+    vector <int> arr(n);
+    for (int &value : arr) value = rng() % 100;
+    vector <int> starts(operations), ends(operations);
+    for (int i = 0; i < operations; i++) {
+        starts[i] = rng() % n;
+        ends[i] = starts[i] + rng() % (n - starts[i]);
+    }
+
+    cout << "n = " << n << ", file " << path << endl;
+    auto begin = chrono::steady_clock::now();
+    MappedSegmentTree::create(path, arr);
+    auto created = chrono::steady_clock::now();
+    cout << "  create: " << chrono::duration<double>(created - begin).count() << " s" << endl;
+
+    vector <long long> values(arr.begin(), arr.end());
+    int errors = 0;
+    {
+        begin = chrono::steady_clock::now();
+        MappedSegmentTree tree(path);
+        auto opened = chrono::steady_clock::now();
+        long long first = tree.GetSum(starts[0], ends[0]);
+        auto answered = chrono::steady_clock::now();
+        long long checksum = first;
+        for (int i = 1; i < operations; i++) checksum += tree.GetSum(starts[i], ends[i]);
+        auto queried = chrono::steady_clock::now();
+        cout << "  open: " << chrono::duration<double>(opened - begin).count()
+             << " s, first query: " << chrono::duration<double>(answered - opened).count()
+             << " s, queries: " << chrono::duration<double>(queried - answered).count()
+             << " s, file " << tree.fileSize() / 1048576.0 << " MB, checksum " << checksum << endl;
+    }
+
+    {
+        MappedSegmentTree tree(path, MappedSegmentTree::WRITE_BACK);
+        vector <long long> difference(n + 1, 0);
+        begin = chrono::steady_clock::now();
+        for (int i = 0; i < operations; i++) {
+            tree.UpdateRange(starts[i], ends[i], i % 7 - 3);
+            difference[starts[i]] += i % 7 - 3;
+            difference[ends[i] + 1] -= i % 7 - 3;
+        }
+        auto updated = chrono::steady_clock::now();
+        tree.flush();
+        auto flushed = chrono::steady_clock::now();
+        cout << "  write back: updates " << chrono::duration<double>(updated - begin).count()
+             << " s, flush " << chrono::duration<double>(flushed - updated).count() << " s" << endl;
+
+        long long running = 0;
+        for (int i = 0; i < n; i++) {
+            running += difference[i];
+            values[i] += running;
+        }
+    }
+
+    // The updates are in the file: a new read only mapping sees them
+    vector <long long> prefix(n + 1, 0);
+    for (int i = 0; i < n; i++) prefix[i + 1] = prefix[i] + values[i];
+    MappedSegmentTree tree(path);
+    for (int i = 0; i < operations; i++) {
+        if (tree.GetSum(starts[i], ends[i]) != prefixSum(prefix, starts[i], ends[i])) errors++;
+    }
+    cout << "  reopened: " << (errors == 0 ? "same sums" : "DIFFERENT SUMS") << endl;
+    unlink(path.c_str());
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        // ./Mapped_Segment_tree bench [n] [file]
+        int n = argc > 2 ? stoi(argv[2]) : 10000000;
+        string path = argc > 3 ? argv[3] : "segment_tree.bin";
+        benchmarkMapped(n, 1000000, path);
+        return 0;
+    }
+
+    vector<int> arr = {1, 2, 3, 4, 5}; // Example array
+    MappedSegmentTree::create("example_tree.bin", arr); // Build the tree in a file
+
+    {
+        MappedSegmentTree tree("example_tree.bin", MappedSegmentTree::WRITE_BACK);
+        tree.UpdateRange(1, 3, 10); // Update range [1, 3] by adding 10
+        tree.flush();
+    }
+
+    MappedSegmentTree tree("example_tree.bin"); // Any process can now open it read only
+    cout << "Sum of range (0, 4): " << tree.GetSum(0, 4) << endl; // Should print 45
+    unlink("example_tree.bin");
+
+    return 0;
+}
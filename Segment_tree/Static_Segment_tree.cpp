@@ -1,118 +1,919 @@
-#include<iostream>
-#include<algorithm>
-#include<vector>
-using namespace std;
-
-/*
-    * This function implements a static segment tree with lazy propagation.
-    * It allows for efficient range updates and range queries on an array.
-    * The segment tree is built from a given array, and it supports updating a range
-    * by adding a value to all elements in that range, as well as querying the sum of elements
-    * in a specified range.
-*/
-
-struct Node { // Structure for Segment Tree Node
-    int start, end, sum, update;    // Start and end indices of the segment, and the sum of the segment
-    Node *left, *right; // Pointers to the left and right children
-
-    Node(int s, int e) : start(s), end(e), sum(0), update(0), left(nullptr), right(nullptr) {}
-};
-
-// Function to build the segment tree from the given array
-void build(Node *&node, int start = 0, int end = -1, vector <int> &arr){
-    if (end == -1) end = arr.size() - 1;
-    node = new Node(start, end);
-    
-    if (start == end) {
-        node->sum = arr[start];
-        return;
-    }
-    
-    int mid = start + (end - start) / 2;
-    build(node->left, start, mid, arr);
-    build(node->right, mid + 1, end, arr);
-    
-    node->sum = node->left->sum + node->right->sum;
-}
-
-// Overloaded function to build the segment tree from a raw array
-void build(Node *&node, int start = 0, int end = -1, int *arr){
-    if (end == -1) cout << "Error: end index not set." << endl;
-    node = new Node(start, end);
-    
-    if (start == end) {
-        node->sum = arr[start];
-        return;
-    }
-    
-    int mid = start + (end - start) / 2;
-    build(node->left, start, mid, arr);
-    build(node->right, mid + 1, end, arr);
-    
-    node->sum = node->left->sum + node->right->sum;
-
-}
-
-void push(Node *&node) {
-    if (node->update != 0) {
-        node->sum += (node->end - node->start + 1) * node->update;
-        if (node->left) {
-            node->left->update += node->update;
-            node->right->update += node->update;
-        }
-        node->update = 0; // Reset the update value after pushing
-    }
-}
-
-// Function to query the sum in a given range
-void UpdateRange(Node *&node, int start, int end, int value){
-    if (!node || start > node->end || end < node->start) return; // Out of range
-    push(node); // Push any pending updates
-
-    if (start <= node->start && end >= node->end) {
-        node->update += value; // Mark the update
-        push(node); // Apply the update immediately
-        return;
-    }
-
-    UpdateRange(node->left, start, end, value);
-    UpdateRange(node->right, start, end, value);
-    
-    node->sum = node->left->sum + node->right->sum; // Update the sum after changes
-}
-
-// Function to get the sum in a given range
-int GetSum(Node *&node, int start, int end) {
-    if (!node || start > node->end || end < node->start) return 0; // Out of range
-    push(node); // Push any pending updates
-
-    if (start <= node->start && end >= node->end) {
-        return node->sum; // Return the sum for the segment
-    }
-
-    int leftSum = GetSum(node->left, start, end);
-    int rightSum = GetSum(node->right, start, end);
-    
-    return leftSum + rightSum; // Combine results from both segments
-}
-
-/*
-you can use this segment tree to perform range updates and queries efficiently.
-For example, you can build the tree from an array, update a range by adding a value, and query the sum of a range.
-you can also add more functionalities like range minimum queries or range maximum queries by modifying the Node structure and the functions accordingly.
-*/
-
-int main() {
-    vector<int> arr = {1, 2, 3, 4, 5}; // Example array
-    Node *root = nullptr;
-    
-    build(root, 0, arr.size() - 1, arr); // Build the segment tree
-
-    cout << "Initial sum of range (0, 4): " << GetSum(root, 0, 4) << endl; // Should print 15
-
-    UpdateRange(root, 1, 3, 10); // Update range [1, 3] by adding 10
-
-    cout << "Sum after update of range (0, 4): " << GetSum(root, 0, 4) << endl; // Should print 25
-
-    return 0;
+#include<iostream>
+#include<algorithm>
+#include<vector>
+#include<random>
+#include<chrono>
+#include<string>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<atomic>
+#include<functional>
+#if defined(__SSE2__)
+#include<immintrin.h>
+#endif
+#include "../Instrumentation/Instrumentation.h"
+#include "../Trace/Trace.h"
+#include "../Benchmark/Benchmark.h"
+using namespace std;
+
+/*
+    * This function implements a static segment tree with lazy propagation.
+    * It allows for efficient range updates and range queries on an array.
+    * The segment tree is built from a given array, and it supports updating a range
+    * by adding a value to all elements in that range, as well as querying the sum of elements
+    * in a specified range.
+*/
+
+struct Node { // Structure for Segment Tree Node
+    int start, end, sum, update;    // Start and end indices of the segment, and the sum of the segment
+    Node *left, *right; // Pointers to the left and right children
+
+    Node(int s, int e) : start(s), end(e), sum(0), update(0), left(nullptr), right(nullptr) {}
+};
+
+// Function to build the segment tree from the given array
+void build(Node *&node, vector <int> &arr, int start = 0, int end = -1){
+    TREE_RECORD_BLOCK(arr.data(), arr.size());
+    if (end == -1) end = arr.size() - 1;
+    TREE_COUNT("segment_tree_node_allocations");
+    node = new Node(start, end);
+    
+    if (start == end) {
+        node->sum = arr[start];
+        return;
+    }
+    
+    int mid = start + (end - start) / 2;
+    build(node->left, arr, start, mid);
+    build(node->right, arr, mid + 1, end);
+    
+    node->sum = node->left->sum + node->right->sum;
+}
+
+// Overloaded function to build the segment tree from a raw array
+void build(Node *&node, int *arr, int start = 0, int end = -1){
+    if (end == -1) cout << "Error: end index not set." << endl;
+    TREE_COUNT("segment_tree_node_allocations");
+    node = new Node(start, end);
+    
+    if (start == end) {
+        node->sum = arr[start];
+        return;
+    }
+    
+    int mid = start + (end - start) / 2;
+    build(node->left, arr, start, mid);
+    build(node->right, arr, mid + 1, end);
+    
+    node->sum = node->left->sum + node->right->sum;
+
+}
+
+// Function to free every node of the segment tree
+void clear(Node *&node) {
+    if (!node) return;
+    clear(node->left);
+    clear(node->right);
+    delete node;
+    node = nullptr;
+}
+
+void push(Node *&node) {
+    TREE_COUNT("segment_tree_push_calls");
+    if (node->update != 0) {
+        TREE_COUNT("segment_tree_push_nonzero");
+        node->sum += (node->end - node->start + 1) * node->update;
+        if (node->left) {
+            node->left->update += node->update;
+            node->right->update += node->update;
+        }
+        node->update = 0; // Reset the update value after pushing
+    }
+}
+
+// Function to query the sum in a given range
+void UpdateRange(Node *&node, int start, int end, int value){
+    TREE_RECORD(TRACE_UPDATE, start, end, value);
+    if (!node) return;
+    TREE_COUNT("segment_tree_update_nodes");
+    push(node); // Push any pending updates, also out of range: the parent reads this sum
+    if (start > node->end || end < node->start) return; // Out of range
+
+    if (start <= node->start && end >= node->end) {
+        node->update += value; // Mark the update
+        push(node); // Apply the update immediately
+        return;
+    }
+
+    UpdateRange(node->left, start, end, value);
+    UpdateRange(node->right, start, end, value);
+    
+    node->sum = node->left->sum + node->right->sum; // Update the sum after changes
+}
+
+// Function to get the sum in a given range
+int GetSum(Node *&node, int start, int end) {
+    TREE_RECORD(TRACE_SUM, start, end);
+    if (!node) return 0;
+    TREE_COUNT("segment_tree_getsum_nodes");
+    if (start > node->end || end < node->start) return 0; // Out of range
+    push(node); // Push any pending updates
+
+    if (start <= node->start && end >= node->end) {
+        return node->sum; // Return the sum for the segment
+    }
+
+    int leftSum = GetSum(node->left, start, end);
+    int rightSum = GetSum(node->right, start, end);
+    
+    return leftSum + rightSum; // Combine results from both segments
+}
+
+// Function to get the sum in a given range without modifying the tree, so many threads can call it together.
+// pending is the sum of the updates of the ancestors that are not pushed yet.
+int PeekSum(const Node *node, int start, int end, int pending = 0) {
+    if (!node || start > node->end || end < node->start) return 0; // Out of range
+    pending += node->update;
+
+    if (start <= node->start && end >= node->end) {
+        return node->sum + (node->end - node->start + 1) * pending; // Same value push would give
+    }
+
+    return PeekSum(node->left, start, end, pending) + PeekSum(node->right, start, end, pending);
+}
+
+struct RangeUpdate { // Structure for an update of UpdateRanges
+    int start, end, value;
+};
+
+// Function to add the values of disjoint sorted ranges, segments[first, last) are the ones that intersect the node
+void updateSegments(Node *node, const vector <RangeUpdate> &segments, size_t first, size_t last) {
+    push(node); // Push any pending updates
+    if (last == first + 1 && segments[first].start <= node->start && segments[first].end >= node->end) {
+        node->update += segments[first].value; // Mark the update
+        push(node); // Apply the update immediately
+        return;
+    }
+
+    // The left child gets the segments that start before mid, the right one the segments that end after it,
+    // only one segment can be in both
+    int mid = node->left->end;
+    size_t split = first;
+    while (split < last && segments[split].start <= mid) split++;
+    size_t rightFirst = split > first && segments[split - 1].end > mid ? split - 1 : split;
+
+    // A child without segments is only pushed: this node reads its sum
+    if (split == first) push(node->left);
+    else updateSegments(node->left, segments, first, split);
+    if (rightFirst == last) push(node->right);
+    else updateSegments(node->right, segments, rightFirst, last);
+
+    node->sum = node->left->sum + node->right->sum; // Update the sum after changes
+}
+
+/*
+    * Function to add every update to its range in one traversal, so every node is pushed once for all of them.
+    * The updates are first turned into disjoint ranges with a constant value: with their 2k ends sorted,
+    * the sum of the updates that contain a position changes only at an end.
+    * The nodes near the root are then visited once instead of once for each update.
+*/
+void UpdateRanges(Node *&node, const vector <RangeUpdate> &updates) {
+    if (!node || updates.empty()) return;
+    TREE_TIME("segment_tree_update_ranges");
+
+    vector <pair <int, int>> ends; // Position and change of the sum from that position on
+    ends.reserve(2 * updates.size());
+    for (const RangeUpdate &update : updates) {
+        int start = max(update.start, node->start), end = min(update.end, node->end);
+        if (start > end) continue; // Out of range
+        ends.push_back(make_pair(start, update.value));
+        ends.push_back(make_pair(end + 1, -update.value));
+    }
+    sort(ends.begin(), ends.end());
+
+    vector <RangeUpdate> segments;
+    int value = 0;
+    for (size_t i = 0; i < ends.size(); ) {
+        int position = ends[i].first;
+        for (; i < ends.size() && ends[i].first == position; i++) value += ends[i].second;
+        if (value != 0 && i < ends.size()) segments.push_back({position, ends[i].first - 1, value});
+    }
+
+    if (!segments.empty()) updateSegments(node, segments, 0, segments.size());
+}
+
+/*
+    * ThreadPool keeps a fixed set of threads waiting for work.
+    * run(tasks, job) calls job(0), ..., job(tasks - 1) on the threads and on the caller, and returns when all of them are done.
+*/
+class ThreadPool {
+    private:
+        vector <thread> workers;
+        mutex lock;
+        condition_variable wake, done;
+        const function <void(int)> *job;
+        atomic <int> next;
+        int tasks, active;
+        unsigned long long generation; // Incremented by every run, the workers wait for a new value
+        bool stopping;
+
+        void work(void) {
+            for (int task = next++; task < tasks; task = next++) (*job)(task);
+        }
+
+        void loop(void) {
+            unsigned long long seen = 0;
+            while (true) {
+                {
+                    unique_lock <mutex> guard(lock);
+                    wake.wait(guard, [&] { return stopping || generation != seen; });
+                    if (stopping) return;
+                    seen = generation;
+                }
+                work();
+                lock_guard <mutex> guard(lock);
+                if (--active == 0) done.notify_one();
+            }
+        }
+
+    public:
+        // threads counts the caller too, so the pool starts threads - 1 workers
+        ThreadPool(int threads = thread::hardware_concurrency())
+            : job(nullptr), next(0), tasks(0), active(0), generation(0), stopping(false) {
+            for (int i = 1; i < threads; i++) workers.emplace_back(&ThreadPool::loop, this);
+        }
+
+        ~ThreadPool(void) {
+            {
+                lock_guard <mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (thread &worker : workers) worker.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool &operator=(const ThreadPool&) = delete;
+
+        void run(int count, const function <void(int)> &task) {
+            if (workers.empty() || count <= 1) {
+                for (int i = 0; i < count; i++) task(i);
+                return;
+            }
+            {
+                lock_guard <mutex> guard(lock);
+                job = &task;
+                tasks = count;
+                next = 0;
+                active = workers.size();
+                generation++;
+            }
+            wake.notify_all();
+            work();
+            unique_lock <mutex> guard(lock);
+            done.wait(guard, [&] { return active == 0; });
+        }
+
+        int size(void) const {
+            return workers.size() + 1;
+        }
+};
+
+enum OperationType { QUERY, UPDATE };
+
+struct Operation { // Structure for an operation of ExecuteBatch
+    OperationType type;
+    int start, end, value; // value is used only by updates
+};
+
+/*
+    * Function to execute a list of operations in order on the tree and to get the results of the queries:
+    * results[i] is the sum of operations[i] if it is a query, 0 if it is an update.
+    * Consecutive queries don't change the tree, so they are split between the threads of the pool and read it with PeekSum.
+    * Consecutive updates commute, so they are applied together by UpdateRanges.
+    * The results are the same of calling GetSum and UpdateRange one after another.
+*/
+vector <int> ExecuteBatch(Node *&root, const vector <Operation> &operations, ThreadPool &pool) {
+    TREE_TIME("segment_tree_batch");
+    for (const Operation &operation : operations) { // Recorded in order, the replay runs them one after another
+        if (operation.type == UPDATE) { TREE_RECORD(TRACE_UPDATE, operation.start, operation.end, operation.value); }
+        else { TREE_RECORD(TRACE_SUM, operation.start, operation.end); }
+    }
+    TREE_TRACE_SILENT();
+    vector <int> results(operations.size(), 0);
+    vector <RangeUpdate> updates;
+    size_t first = 0;
+
+    while (first < operations.size()) {
+        size_t last = first;
+        while (last < operations.size() && operations[last].type == operations[first].type) last++;
+
+        if (operations[first].type == UPDATE) {
+            updates.clear();
+            for (size_t i = first; i < last; i++) {
+                updates.push_back({operations[i].start, operations[i].end, operations[i].value});
+            }
+            UpdateRanges(root, updates);
+        } else {
+            size_t count = last - first;
+            size_t chunk = max<size_t>(64, count / (4 * pool.size()) + 1); // A few chunks per thread balance the load
+            int chunks = (count + chunk - 1) / chunk;
+            const Node *tree = root;
+            pool.run(chunks, [&](int index) {
+                size_t begin = first + index * chunk, finish = min(last, begin + chunk);
+                for (size_t i = begin; i < finish; i++) {
+                    results[i] = PeekSum(tree, operations[i].start, operations[i].end);
+                }
+            });
+        }
+        first = last;
+    }
+
+    return results;
+}
+
+struct BuildTask { // Subtree built by one thread of parallelBuild
+    Node **node;
+    int start, end;
+};
+
+// Function to create the top levels of the tree and to collect the subtrees below them
+void buildTop(Node *&node, vector <int> &arr, int start, int end, int depth, vector <BuildTask> &tasks) {
+    if (depth == 0 || start == end) {
+        tasks.push_back({&node, start, end});
+        return;
+    }
+
+    node = new Node(start, end);
+    int mid = start + (end - start) / 2;
+    buildTop(node->left, arr, start, mid, depth - 1, tasks);
+    buildTop(node->right, arr, mid + 1, end, depth - 1, tasks);
+}
+
+// Function to compute the sums of the top levels when their subtrees are built
+void sumTop(Node *node, int depth) {
+    if (depth == 0 || !node->left) return;
+    sumTop(node->left, depth - 1);
+    sumTop(node->right, depth - 1);
+    node->sum = node->left->sum + node->right->sum;
+}
+
+/*
+    * Function to build the same tree of build() with the threads of the pool.
+    * The top levels are created first, the subtrees below them are independent: there are about four for
+    * each thread, and each thread takes the next one when it finishes its own, so a slow thread
+    * doesn't keep the others waiting. The sums of the top levels are computed at the end.
+*/
+void parallelBuild(Node *&node, vector <int> &arr, ThreadPool &pool) {
+    TREE_RECORD_BLOCK(arr.data(), arr.size());
+    int depth = 0;
+    while ((1 << depth) < 4 * pool.size() && depth < 20) depth++;
+
+    vector <BuildTask> tasks;
+    buildTop(node, arr, 0, arr.size() - 1, depth, tasks);
+    pool.run(tasks.size(), [&](int index) {
+        TREE_TRACE_SILENT(); // The array is recorded once above, not by the build of every subtree
+        build(*tasks[index].node, arr, tasks[index].start, tasks[index].end);
+    });
+    sumTop(node, depth);
+}
+
+/*
+    * FlatSegmentTree is a segment tree with the same operations (range add and range sum)
+    * for arrays whose size is fixed when the tree is built.
+    * It doesn't use nodes: the tree is stored in two arrays, the root is at position 1
+    * and the children of position i are 2i and 2i + 1, so start, end and the pointers are not needed.
+    * The number of leaves is rounded up to a power of 2, the extra leaves contain 0.
+    * Updates and queries are iterative and go from the leaves to the root.
+    * The lazy value of a node is never pushed to its children: the queries add the lazy values of the
+    * partially covered ancestors instead, so GetSum only reads the arrays.
+*/
+class FlatSegmentTree {
+    private:
+        int n; // Number of elements
+        int leaves; // Number of leaves (power of 2), the leaf of element i is at position leaves + i
+        int levels; // Height of the tree, leaves = 2^levels
+        vector <int> sum; // Sum of the segment of every node, including its own lazy value
+        vector <int> update; // Lazy value of every internal node: it is added to all the elements of its segment
+
+        void apply(int node, int value, int length) {
+            sum[node] += value * length;
+            if (node < leaves) update[node] += value;
+        }
+
+        void recompute(int node, int length) {
+            sum[node] = sum[2 * node] + sum[2 * node + 1] + update[node] * length;
+        }
+
+        // Number of elements of [start, end] inside the segment of node, or 0 if the node is completely inside
+        int partialOverlap(int node, int level, int start, int end) const {
+            int first = (node << level) - leaves;
+            int last = first + (1 << level) - 1;
+            if (start <= first && last <= end) return 0;
+            return min(last, end) - max(first, start) + 1;
+        }
+
+    public:
+        FlatSegmentTree(void) : n(0), leaves(1), levels(0), sum(2, 0), update(1, 0) {}
+
+        FlatSegmentTree(const vector <int> &arr) : FlatSegmentTree() {
+            build(arr);
+        }
+
+        // Function to build the segment tree from the given array in O(n)
+        void build(const vector <int> &arr) {
+            TREE_RECORD_BLOCK(arr.data(), arr.size());
+            n = arr.size();
+            leaves = 1;
+            levels = 0;
+            while (leaves < n) {
+                leaves *= 2;
+                levels++;
+            }
+
+            sum.assign(2 * leaves, 0);
+            update.assign(leaves, 0);
+            copy(arr.begin(), arr.end(), sum.begin() + leaves);
+            for (int node = leaves - 1; node > 0; node--) {
+                sum[node] = sum[2 * node] + sum[2 * node + 1];
+            }
+        }
+
+        // Function to add value to every element in [start, end]
+        void UpdateRange(int start, int end, int value) {
+            TREE_RECORD(TRACE_UPDATE, start, end, value);
+            start = max(start, 0);
+            end = min(end, n - 1);
+            if (start > end) return; // Out of range
+
+            // Nodes that cover [start, end] exactly, from the leaves up
+            int length = 1;
+            for (int l = start + leaves, r = end + leaves + 1; l < r; l /= 2, r /= 2, length *= 2) {
+                if (l & 1) apply(l++, value, length);
+                if (r & 1) apply(--r, value, length);
+            }
+
+            // Their ancestors are the ancestors of the first and of the last leaf
+            length = 2;
+            for (int level = 1; level <= levels; level++, length *= 2) {
+                int first = (start + leaves) >> level, last = (end + leaves) >> level;
+                recompute(first, length);
+                if (last != first) recompute(last, length);
+            }
+        }
+
+        // Function to get the sum in [start, end]
+        int GetSum(int start, int end) const {
+            TREE_RECORD(TRACE_SUM, start, end);
+            start = max(start, 0);
+            end = min(end, n - 1);
+            if (start > end) return 0; // Out of range
+
+            int result = 0;
+            for (int l = start + leaves, r = end + leaves + 1; l < r; l /= 2, r /= 2) {
+                if (l & 1) result += sum[l++];
+                if (r & 1) result += sum[--r];
+            }
+
+            // Lazy values of the ancestors that contain only a part of [start, end]
+            for (int level = 1; level <= levels; level++) {
+                int first = (start + leaves) >> level, last = (end + leaves) >> level;
+                if (update[first] != 0) result += update[first] * partialOverlap(first, level, start, end);
+                if (last != first && update[last] != 0) result += update[last] * partialOverlap(last, level, start, end);
+            }
+
+            return result;
+        }
+
+        int size(void) const {
+            return n;
+        }
+
+        size_t memoryUsage(void) const {
+            return (sum.size() + update.size()) * sizeof(int);
+        }
+};
+
+// Function to compute the prefix sums of arr in 64 bits: prefix[i] is the sum of the first i elements.
+// With SSE2 four elements are widened to 64 bits and summed in two registers at every step.
+void prefixSums(const vector <int> &arr, vector <long long> &prefix) {
+    size_t n = arr.size(), i = 0;
+    prefix.resize(n + 1);
+    prefix[0] = 0;
+    long long running = 0;
+
+#if defined(__SSE2__)
+    __m128i carry = _mm_setzero_si128(); // Sum of the elements before i, in both lanes
+    for (; i + 4 <= n; i += 4) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&arr[i]));
+        __m128i sign = _mm_srai_epi32(values, 31);
+        __m128i low = _mm_unpacklo_epi32(values, sign); // arr[i], arr[i + 1]
+        __m128i high = _mm_unpackhi_epi32(values, sign); // arr[i + 2], arr[i + 3]
+        low = _mm_add_epi64(_mm_add_epi64(low, _mm_slli_si128(low, 8)), carry);
+        carry = _mm_shuffle_epi32(low, _MM_SHUFFLE(3, 2, 3, 2));
+        high = _mm_add_epi64(_mm_add_epi64(high, _mm_slli_si128(high, 8)), carry);
+        carry = _mm_shuffle_epi32(high, _MM_SHUFFLE(3, 2, 3, 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&prefix[i + 1]), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&prefix[i + 3]), high);
+    }
+    running = prefix[i];
+#endif
+
+    for (; i < n; i++) {
+        running += arr[i];
+        prefix[i + 1] = running;
+    }
+}
+
+/*
+    * FenwickTree answers the same UpdateRange / GetSum pair with two Fenwick trees (binary indexed trees),
+    * stored together so that every step of a query reads a single cache line.
+    * Adding v to [start, end] adds v to mul from start and removes it after end, and keeps the
+    * constant part in off, so that the sum of the first i elements is mulSum(i) * i - offSum(i).
+    * The initial array is stored in off, built in O(n) from its prefix sums.
+    * Sums are 64 bits.
+*/
+class FenwickTree {
+    private:
+        struct Cell {
+            long long mul; // Fenwick tree of the values added from an index on
+            long long off; // Fenwick tree of the constant part of the sums
+        };
+
+        int n;
+        vector <Cell> cells; // cells[i] covers the elements (i - lowbit(i), i], cells[0] is not used
+
+        void add(int i, long long mul, long long off) {
+            for (; i <= n; i += i & -i) {
+                cells[i].mul += mul;
+                cells[i].off += off;
+            }
+        }
+
+        // Function to get the sum of the first count elements
+        long long prefix(int count) const {
+            long long mul = 0, off = 0;
+            for (int i = count; i > 0; i -= i & -i) {
+                mul += cells[i].mul;
+                off += cells[i].off;
+            }
+            return mul * count - off;
+        }
+
+        // Function to get prefix(first) and prefix(second) in the same loop, so the two walks overlap
+        void prefix(int first, int second, long long &firstSum, long long &secondSum) const {
+            long long firstMul = 0, firstOff = 0, secondMul = 0, secondOff = 0;
+            int i = first, j = second;
+            for (; i > 0 && j > 0; i -= i & -i, j -= j & -j) {
+                firstMul += cells[i].mul;
+                firstOff += cells[i].off;
+                secondMul += cells[j].mul;
+                secondOff += cells[j].off;
+            }
+            for (; i > 0; i -= i & -i) {
+                firstMul += cells[i].mul;
+                firstOff += cells[i].off;
+            }
+            for (; j > 0; j -= j & -j) {
+                secondMul += cells[j].mul;
+                secondOff += cells[j].off;
+            }
+            firstSum = firstMul * first - firstOff;
+            secondSum = secondMul * second - secondOff;
+        }
+
+    public:
+        FenwickTree(void) : n(0), cells(1) {}
+
+        FenwickTree(const vector <int> &arr) : FenwickTree() {
+            build(arr);
+        }
+
+        // Function to build the trees from the given array in O(n)
+        void build(const vector <int> &arr) {
+            TREE_RECORD_BLOCK(arr.data(), arr.size());
+            vector <long long> prefix;
+            prefixSums(arr, prefix);
+
+            n = arr.size();
+            cells.assign(n + 1, Cell{0, 0});
+            for (int i = 1; i <= n; i++) {
+                cells[i].off = prefix[i - (i & -i)] - prefix[i];
+            }
+        }
+
+        // Function to add value to every element in [start, end]
+        void UpdateRange(int start, int end, int value) {
+            TREE_RECORD(TRACE_UPDATE, start, end, value);
+            start = max(start, 0);
+            end = min(end, n - 1);
+            if (start > end) return; // Out of range
+
+            add(start + 1, value, (long long)value * start);
+            add(end + 2, -value, -(long long)value * (end + 1));
+        }
+
+        // Function to get the sum in [start, end]
+        long long GetSum(int start, int end) const {
+            TREE_RECORD(TRACE_SUM, start, end);
+            start = max(start, 0);
+            end = min(end, n - 1);
+            if (start > end) return 0; // Out of range
+
+            long long before, upTo;
+            prefix(start, end + 1, before, upTo);
+            return upTo - before;
+        }
+
+        int size(void) const {
+            return n;
+        }
+
+        size_t memoryUsage(void) const {
+            return cells.size() * sizeof(Cell);
+        }
+};
+
+// Build, range updates and range sums on the pointer tree, on FlatSegmentTree and on FenwickTree
+void benchmarkBackends(int n, int operations) {
+    mt19937 rng(42);
+    vector <int> arr(n);
+    for (int &value : arr) value = rng() % 100;
+    vector <int> starts(operations), ends(operations);
+    for (int i = 0; i < operations; i++) {
+        starts[i] = rng() % n;
+        ends[i] = starts[i] + rng() % (n - starts[i]);
+    }
+
+    cout << "n = " << n << endl;
+    long long checksum = 0;
+
+    Node *root = nullptr;
+    auto begin = chrono::steady_clock::now();
+    build(root, arr);
+    auto built = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) UpdateRange(root, starts[i], ends[i], i % 7 - 3);
+    auto updated = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) checksum += GetSum(root, starts[operations - 1 - i], ends[operations - 1 - i]);
+    auto queried = chrono::steady_clock::now();
+    cout << "  pointer: build " << chrono::duration<double>(built - begin).count()
+         << " s, updates " << chrono::duration<double>(updated - built).count()
+         << " s, queries " << chrono::duration<double>(queried - updated).count()
+         << " s, memory " << (2 * (size_t)n - 1) * sizeof(Node) / 1048576.0 << " MB, checksum " << checksum << endl;
+    clear(root);
+
+    checksum = 0;
+    FlatSegmentTree tree;
+    begin = chrono::steady_clock::now();
+    tree.build(arr);
+    built = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) tree.UpdateRange(starts[i], ends[i], i % 7 - 3);
+    updated = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) checksum += tree.GetSum(starts[operations - 1 - i], ends[operations - 1 - i]);
+    queried = chrono::steady_clock::now();
+    cout << "  flat:    build " << chrono::duration<double>(built - begin).count()
+         << " s, updates " << chrono::duration<double>(updated - built).count()
+         << " s, queries " << chrono::duration<double>(queried - updated).count()
+         << " s, memory " << tree.memoryUsage() / 1048576.0 << " MB, checksum " << checksum << endl;
+
+    checksum = 0;
+    FenwickTree fenwick;
+    begin = chrono::steady_clock::now();
+    fenwick.build(arr);
+    built = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) fenwick.UpdateRange(starts[i], ends[i], i % 7 - 3);
+    updated = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) {
+        checksum += (int)fenwick.GetSum(starts[operations - 1 - i], ends[operations - 1 - i]); // Same overflow of the int trees
+    }
+    queried = chrono::steady_clock::now();
+    cout << "  fenwick: build " << chrono::duration<double>(built - begin).count()
+         << " s, updates " << chrono::duration<double>(updated - built).count()
+         << " s, queries " << chrono::duration<double>(queried - updated).count()
+         << " s, memory " << fenwick.memoryUsage() / 1048576.0 << " MB, checksum " << checksum << endl;
+}
+
+// Batches of queries and updates, one after another and with ExecuteBatch on different numbers of threads
+void benchmarkBatch(int n, int operations, const vector <int> &threadCounts) {
+    mt19937 rng(7);
+    vector <int> arr(n);
+    for (int &value : arr) value = rng() % 100;
+    vector <Operation> batch(operations);
+    for (int i = 0; i < operations; i++) {
+        Operation &operation = batch[i];
+        operation.type = i % 1024 < 896 ? QUERY : UPDATE; // Runs of 896 queries and 128 updates
+        operation.start = rng() % n;
+        operation.end = operation.start + rng() % (n - operation.start);
+        operation.value = i % 7 - 3;
+    }
+
+    cout << "n = " << n << ", operations = " << operations << endl;
+    Node *root = nullptr;
+    build(root, arr);
+    vector <int> expected(operations, 0);
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) {
+        if (batch[i].type == QUERY) expected[i] = GetSum(root, batch[i].start, batch[i].end);
+        else UpdateRange(root, batch[i].start, batch[i].end, batch[i].value);
+    }
+    double sequential = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "  sequential: " << sequential << " s, " << operations / sequential / 1e6 << " Mops/s" << endl;
+
+    // Every tree is freed at the end: a tree built in freed memory has its nodes in a different order
+    vector <Node*> trees(1, root);
+    for (int threads : threadCounts) {
+        build(root, arr);
+        trees.push_back(root);
+        ThreadPool pool(threads);
+        begin = chrono::steady_clock::now();
+        vector <int> results = ExecuteBatch(root, batch, pool);
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        cout << "  batch, " << threads << " threads: " << elapsed << " s, "
+             << operations / elapsed / 1e6 << " Mops/s, " << (results == expected ? "same results" : "DIFFERENT RESULTS") << endl;
+    }
+    for (Node *&tree : trees) clear(tree);
+}
+
+// Function to check that two trees have the same segments and sums
+bool sameTree(const Node *a, const Node *b) {
+    if (!a || !b) return a == b;
+    return a->start == b->start && a->end == b->end && a->sum == b->sum
+        && sameTree(a->left, b->left) && sameTree(a->right, b->right);
+}
+
+// build() against parallelBuild() on different numbers of threads
+void benchmarkBuild(int n, const vector <int> &threadCounts) {
+    mt19937 rng(11);
+    vector <int> arr(n);
+    for (int &value : arr) value = rng() % 100;
+
+    cout << "n = " << n << endl;
+    Node *expected = nullptr;
+    auto begin = chrono::steady_clock::now();
+    build(expected, arr);
+    double sequential = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "  build: " << sequential << " s" << endl;
+
+    for (int threads : threadCounts) {
+        Node *root = nullptr;
+        ThreadPool pool(threads);
+        begin = chrono::steady_clock::now();
+        parallelBuild(root, arr, pool);
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        cout << "  parallelBuild, " << threads << " threads: " << elapsed << " s, speedup " << sequential / elapsed
+             << ", " << (sameTree(root, expected) ? "same tree" : "DIFFERENT TREE") << endl;
+        clear(root);
+    }
+    clear(expected);
+}
+
+/*
+you can use this segment tree to perform range updates and queries efficiently.
+For example, you can build the tree from an array, update a range by adding a value, and query the sum of a range.
+you can also add more functionalities like range minimum queries or range maximum queries by modifying the Node structure and the functions accordingly.
+*/
+
+// Workload of the shared suite on one backend: n values, the queries are GetSum and the updates are
+// UpdateRange, both on the range between the two keys of the operation
+void suiteWorkload(const Workload &workload, const string &backend) {
+    int n = (int)workload.size;
+    KeyGenerator values(workload.distribution, n, workload.seed());
+    vector <int> arr(n);
+    for (int &value : arr) value = (int)values.below(100);
+    BenchmarkRun run(backend, workload);
+
+    auto operate = [&](auto update, auto query) {
+        run.run(n, [&](bool read, uint64_t key, uint64_t other) -> long long {
+            int start = (int)min(key, other), end = (int)max(key, other);
+            if (read) return (int)query(start, end); // Same overflow of the int trees
+            update(start, end, key & 1 ? 1 : -1);
+            return 0;
+        });
+    };
+
+    if (backend == "static_segment_tree") {
+        Node *root = nullptr;
+        run.startBuild();
+        build(root, arr);
+        run.endBuild(n);
+        operate([&](int start, int end, int value) { UpdateRange(root, start, end, value); },
+                [&](int start, int end) { return GetSum(root, start, end); });
+        clear(root);
+    } else if (backend == "flat_segment_tree") {
+        run.startBuild();
+        FlatSegmentTree tree(arr);
+        run.endBuild(n);
+        operate([&](int start, int end, int value) { tree.UpdateRange(start, end, value); },
+                [&](int start, int end) { return tree.GetSum(start, end); });
+    } else {
+        run.startBuild();
+        FenwickTree tree(arr);
+        run.endBuild(n);
+        operate([&](int start, int end, int value) { tree.UpdateRange(start, end, value); },
+                [&](int start, int end) { return tree.GetSum(start, end); });
+    }
+}
+
+// Replay the builds, range updates and range sums of a trace on one backend
+template <class Build, class Update, class Query>
+bool replay(const string &path, const string &backend, Build build, Update update, Query query) {
+    vector <int> arr;
+    return replayTrace(path, backend, [&](const TraceRecord &record) -> long long {
+        int start = (int)record.arguments[0], end = (int)record.arguments[1];
+        switch (record.operation) {
+            case TRACE_BLOCK: TraceReader::values(record, arr); build(arr); return 0;
+            case TRACE_UPDATE: update(start, end, (int)record.arguments[2]); return 0;
+            case TRACE_SUM: return (int)query(start, end); // Same overflow of the int trees
+            default: throw unsupported(record);
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        // Sizes from the command line, 1e8 needs about 8 GB for the pointer tree
+        vector <int> sizes;
+        for (int i = 2; i < argc; i++) sizes.push_back(stoi(argv[i]));
+        if (sizes.empty()) sizes = {1000000, 10000000};
+        for (int n : sizes) benchmarkBackends(n, 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "build") {
+        // ./Static_Segment_tree build [n] [threads...]
+        int n = argc > 2 ? stoi(argv[2]) : 10000000;
+        vector <int> threadCounts;
+        for (int i = 3; i < argc; i++) threadCounts.push_back(stoi(argv[i]));
+        if (threadCounts.empty()) threadCounts = {1, 4, 16, 32};
+        benchmarkBuild(n, threadCounts);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "batch") {
+        // ./Static_Segment_tree batch [n] [threads...]
+        int n = argc > 2 ? stoi(argv[2]) : 1000000;
+        vector <int> threadCounts;
+        for (int i = 3; i < argc; i++) threadCounts.push_back(stoi(argv[i]));
+        if (threadCounts.empty()) threadCounts = {1, 2, 4, 8};
+        benchmarkBatch(n, 1000000, threadCounts);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "suite") {
+        // ./Static_Segment_tree suite [sizes...], one JSON line for every workload of every backend
+        vector <uint64_t> sizes = suiteSizes(argc, argv, 2);
+        bool passed = true;
+        for (string backend : {"static_segment_tree", "flat_segment_tree", "fenwick_tree"}) {
+            passed = runSuite(backend, sizes, [&](const Workload &workload) { suiteWorkload(workload, backend); }) && passed;
+        }
+        return passed ? 0 : 1;
+    }
+    if (argc > 2 && string(argv[1]) == "replay") {
+        // ./Static_Segment_tree replay <trace> [pointer | flat | fenwick], by default all of them
+        string backend = argc > 3 ? argv[3] : "";
+        bool passed = true;
+        if (backend.empty() || backend == "pointer") {
+            Node *root = nullptr;
+            passed = replay(argv[2], "pointer", [&](vector <int> &arr) { clear(root); build(root, arr); },
+                            [&](int start, int end, int value) { UpdateRange(root, start, end, value); },
+                            [&](int start, int end) { return GetSum(root, start, end); }) && passed;
+            clear(root);
+        }
+        if (backend.empty() || backend == "flat") {
+            FlatSegmentTree tree;
+            passed = replay(argv[2], "flat", [&](vector <int> &arr) { tree.build(arr); },
+                            [&](int start, int end, int value) { tree.UpdateRange(start, end, value); },
+                            [&](int start, int end) { return tree.GetSum(start, end); }) && passed;
+        }
+        if (backend.empty() || backend == "fenwick") {
+            FenwickTree tree;
+            passed = replay(argv[2], "fenwick", [&](vector <int> &arr) { tree.build(arr); },
+                            [&](int start, int end, int value) { tree.UpdateRange(start, end, value); },
+                            [&](int start, int end) { return tree.GetSum(start, end); }) && passed;
+        }
+        return passed ? 0 : 1;
+    }
+
+    vector<int> arr = {1, 2, 3, 4, 5}; // Example array
+    Node *root = nullptr;
+    
+    build(root, arr, 0, arr.size() - 1); // Build the segment tree
+
+    cout << "Initial sum of range (0, 4): " << GetSum(root, 0, 4) << endl; // Should print 15
+
+    UpdateRange(root, 1, 3, 10); // Update range [1, 3] by adding 10
+
+    cout << "Sum after update of range (0, 4): " << GetSum(root, 0, 4) << endl; // Should print 45
+
+    FlatSegmentTree flat(arr); // Same operations on the array based tree
+    flat.UpdateRange(1, 3, 10);
+    cout << "Flat tree sum of range (0, 4): " << flat.GetSum(0, 4) << endl; // Should print 45
+
+    FenwickTree fenwick(arr); // Same operations with two Fenwick trees
+    fenwick.UpdateRange(1, 3, 10);
+    cout << "Fenwick tree sum of range (0, 4): " << fenwick.GetSum(0, 4) << endl; // Should print 45
+
+    clear(root);
+
+    TREE_STATS_DUMP(cout); // Counters of the example, only with -DTREE_STATS
+
+    return 0;
 }
\ No newline at end of file
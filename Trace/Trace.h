@@ -0,0 +1,341 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+    * Binary traces of the operations of the trees, to replay the same traffic on every implementation.
+    *
+    *   file:     "TREETRC1", then one record after the other until the end of the file
+    *   record:   one byte with the operation, then its arguments as varints
+    *   varint:   7 bits at a time from the lowest, the high bit of a byte is set if another byte follows;
+    *             every argument is a 64 bit integer in zigzag form (0, -1, 1, -2, ... become 0, 1, 2, 3, ...),
+    *             so small values of any sign take one byte
+    *
+    *   TRACE_INSERT  key               AVL insert
+    *   TRACE_DELETE  key               AVL del
+    *   TRACE_FIND    key               AVL contains
+    *   TRACE_BLOCK   count, values...  build of a static tree, append of a VectorTree
+    *   TRACE_APPEND  value             VectorTree insert
+    *   TRACE_SET     index, value      VectorTree set, DynamicST insert
+    *   TRACE_UPDATE  start, end, value UpdateRange of the segment trees, VectorTree add
+    *   TRACE_SUM     start, end        GetSum of the newest version
+    *   TRACE_VERSION_SUM  version, start, end   GetSum of an older version
+    *
+    * Compiled with -DTREE_TRACE, the public operations of the trees record themselves with TREE_RECORD
+    * when the environment variable TREE_TRACE_FILE is set: every %p in it becomes the process id, so the
+    * processes of the benchmark suite write different files. Only the outermost traced call of a thread
+    * is recorded, so a recursive GetSum or an AVLTree::insert that calls insert is one record.
+    * TREE_TRACE_SILENT() marks the rest of a scope as part of operations already recorded, also on other
+    * threads: a parallel build or a batch records its operations once and then runs the traced calls silently.
+    * Without -DTREE_TRACE the macros are empty statements.
+    *
+    * The replay maps the whole trace and decodes it in place, so a trace of many GB is streamed by the
+    * page cache without being read into memory first.
+*/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef TREE_TRACE
+#include <cstdlib>
+#include <mutex>
+#endif
+
+const char traceMagic[8] = {'T', 'R', 'E', 'E', 'T', 'R', 'C', '1'};
+
+enum TraceOperation : uint8_t {
+    TRACE_INSERT = 1, TRACE_DELETE, TRACE_FIND, TRACE_BLOCK, TRACE_APPEND,
+    TRACE_SET, TRACE_UPDATE, TRACE_SUM, TRACE_VERSION_SUM
+};
+
+inline uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Number of arguments of an operation, the values of a block are not counted
+inline int traceArguments(uint8_t operation) {
+    switch (operation) {
+        case TRACE_INSERT: case TRACE_DELETE: case TRACE_FIND: case TRACE_BLOCK: case TRACE_APPEND: return 1;
+        case TRACE_SET: case TRACE_SUM: return 2;
+        case TRACE_UPDATE: case TRACE_VERSION_SUM: return 3;
+        default: return -1;
+    }
+}
+
+#ifdef TREE_TRACE
+
+/*
+    * Recorder of the operations of this process: the records are encoded in a buffer that is written
+    * to the file when it's full, when the program exits and when flush is called (the benchmark suite
+    * calls it before a child process ends with _exit).
+*/
+class TraceRecorder {
+    private:
+        static const size_t bufferSize = 1 << 20;
+        std::mutex lock; // The readers of the concurrent trees record from many threads
+        int file;
+        std::vector <uint8_t> buffer;
+
+        TraceRecorder(void) : file(-1) {
+            const char *pattern = getenv("TREE_TRACE_FILE");
+            if (!pattern || !*pattern) return;
+            std::string path;
+            for (const char *c = pattern; *c; c++) {
+                if (c[0] == '%' && c[1] == 'p') {
+                    path += std::to_string(getpid());
+                    c++;
+                } else {
+                    path += *c;
+                }
+            }
+            file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (file < 0) {
+                perror(("TREE_TRACE_FILE " + path).c_str());
+                return;
+            }
+            buffer.reserve(bufferSize + 64);
+            buffer.insert(buffer.end(), traceMagic, traceMagic + sizeof(traceMagic));
+        }
+
+        ~TraceRecorder(void) {
+            flush();
+            if (file >= 0) close(file);
+        }
+
+        void put(uint64_t value) {
+            while (value >= 0x80) {
+                buffer.push_back((uint8_t)(value | 0x80));
+                value >>= 7;
+            }
+            buffer.push_back((uint8_t)value);
+        }
+
+        void writeBuffer(void) {
+            size_t done = 0;
+            while (done < buffer.size()) {
+                ssize_t written = write(file, buffer.data() + done, buffer.size() - done);
+                if (written < 0) {
+                    perror("TraceRecorder");
+                    close(file);
+                    file = -1;
+                    break;
+                }
+                done += written;
+            }
+            buffer.clear();
+        }
+
+    public:
+        static TraceRecorder &instance(void) {
+            static TraceRecorder recorder;
+            return recorder;
+        }
+
+        bool active(void) const {
+            return file >= 0;
+        }
+
+        void record(uint8_t operation, int64_t a, int64_t b = 0, int64_t c = 0) {
+            std::lock_guard <std::mutex> guard(lock);
+            if (file < 0) return;
+            buffer.push_back(operation);
+            int arguments = traceArguments(operation);
+            put(zigzag(a));
+            if (arguments > 1) put(zigzag(b));
+            if (arguments > 2) put(zigzag(c));
+            if (buffer.size() >= bufferSize) writeBuffer();
+        }
+
+        void recordBlock(const int *values, size_t count) {
+            std::lock_guard <std::mutex> guard(lock);
+            if (file < 0) return;
+            buffer.push_back(TRACE_BLOCK);
+            put(zigzag((int64_t)count));
+            for (size_t i = 0; i < count; i++) {
+                put(zigzag(values[i]));
+                if (buffer.size() >= bufferSize) writeBuffer();
+            }
+        }
+
+        void flush(void) {
+            std::lock_guard <std::mutex> guard(lock);
+            if (file >= 0 && !buffer.empty()) writeBuffer();
+        }
+};
+
+// Records an operation if it's the outermost traced call of the thread, until the end of the scope
+class TraceScope {
+    private:
+        static int &depth(void) {
+            thread_local int calls = 0;
+            return calls;
+        }
+
+    public:
+        TraceScope(void) {
+            depth()++;
+        }
+
+        ~TraceScope(void) {
+            depth()--;
+        }
+
+        bool outermost(void) const {
+            return depth() == 1;
+        }
+};
+
+#define TREE_RECORD(...) \
+    TraceScope treeTraceScope; \
+    if (treeTraceScope.outermost()) TraceRecorder::instance().record(__VA_ARGS__)
+#define TREE_RECORD_BLOCK(values, count) \
+    TraceScope treeTraceScope; \
+    if (treeTraceScope.outermost()) TraceRecorder::instance().recordBlock(values, count)
+#define TREE_TRACE_SILENT() TraceScope treeTraceSilent
+#define TREE_TRACE_FLUSH() TraceRecorder::instance().flush()
+
+#else
+
+#define TREE_RECORD(...) do {} while (0)
+#define TREE_RECORD_BLOCK(values, count) do {} while (0)
+#define TREE_TRACE_SILENT() do {} while (0)
+#define TREE_TRACE_FLUSH() do {} while (0)
+
+#endif
+
+struct TraceRecord {
+    uint8_t operation;
+    int64_t arguments[3];
+    const uint8_t *values; // Encoded values of a block, arguments[0] of them, read them with TraceReader::values
+};
+
+// Reader of a mapped trace, the records are decoded one at a time from the mapping
+class TraceReader {
+    private:
+        const uint8_t *begin, *position, *end;
+        size_t length;
+
+        uint64_t get(void) {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (position == end) throw std::runtime_error("Truncated trace");
+                uint8_t byte = *position++;
+                value |= (uint64_t)(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return value;
+            }
+            throw std::runtime_error("Invalid varint in the trace");
+        }
+
+    public:
+        explicit TraceReader(const std::string &path) : begin(nullptr), position(nullptr), end(nullptr), length(0) {
+            int file = open(path.c_str(), O_RDONLY);
+            if (file < 0) throw std::runtime_error("Cannot open " + path + ": " + strerror(errno));
+            struct stat info;
+            if (fstat(file, &info) < 0 || info.st_size < (off_t)sizeof(traceMagic)) {
+                close(file);
+                throw std::runtime_error(path + " is not a trace");
+            }
+            length = info.st_size;
+            void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+            close(file); // The mapping keeps the file
+            if (mapping == MAP_FAILED) throw std::runtime_error("Cannot map " + path + ": " + strerror(errno));
+            madvise(mapping, length, MADV_SEQUENTIAL); // Read ahead, the pages already replayed can be dropped first
+            begin = (const uint8_t*)mapping;
+            end = begin + length;
+            if (memcmp(begin, traceMagic, sizeof(traceMagic)) != 0) {
+                munmap(mapping, length);
+                throw std::runtime_error(path + " is not a trace");
+            }
+            position = begin + sizeof(traceMagic);
+        }
+
+        ~TraceReader(void) {
+            munmap((void*)begin, length);
+        }
+
+        TraceReader(const TraceReader&) = delete;
+        TraceReader &operator=(const TraceReader&) = delete;
+
+        // Function to decode the next record, false at the end of the trace
+        bool next(TraceRecord &record) {
+            if (position == end) return false;
+            record.operation = *position++;
+            int arguments = traceArguments(record.operation);
+            if (arguments < 0) throw std::runtime_error("Unknown operation " + std::to_string(record.operation) + " in the trace");
+            for (int i = 0; i < arguments; i++) record.arguments[i] = unzigzag(get());
+            record.values = position;
+            if (record.operation == TRACE_BLOCK) {
+                if (record.arguments[0] < 0) throw std::runtime_error("Invalid block in the trace");
+                for (int64_t i = 0; i < record.arguments[0]; i++) get(); // Skip the values, they are decoded on demand
+            }
+            return true;
+        }
+
+        // Function to decode the values of a block record
+        static void values(const TraceRecord &record, std::vector <int> &result) {
+            result.resize(record.arguments[0]);
+            const uint8_t *p = record.values;
+            for (int &value : result) {
+                uint64_t raw = 0;
+                for (int shift = 0; ; shift += 7) {
+                    uint8_t byte = *p++;
+                    raw |= (uint64_t)(byte & 0x7F) << shift;
+                    if (!(byte & 0x80)) break;
+                }
+                value = (int)unzigzag(raw);
+            }
+        }
+
+        size_t bytes(void) const {
+            return length;
+        }
+};
+
+/*
+    * Function to replay a trace on a backend and print one JSON line with the throughput and the checksum.
+    * execute(record) runs one record and returns the result of a query (0 for the updates); it throws
+    * invalid_argument for an operation that the backend doesn't have.
+    * The checksum is the sum of the results of the queries, the same on two backends that give the same answers.
+*/
+template <class Execute>
+bool replayTrace(const std::string &path, const std::string &backend, Execute execute) {
+    try {
+        TraceReader reader(path);
+        TraceRecord record;
+        long long operations = 0, checksum = 0;
+        auto begin = std::chrono::steady_clock::now();
+        while (reader.next(record)) {
+            checksum += execute(record);
+            operations++;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        printf("{\"trace\":\"%s\",\"backend\":\"%s\",\"bytes\":%zu,\"operations\":%lld,\"seconds\":%.6f,"
+               "\"ops_per_sec\":%.0f,\"checksum\":%lld}\n",
+               path.c_str(), backend.c_str(), reader.bytes(), operations, seconds,
+               seconds > 0 ? operations / seconds : 0.0, checksum);
+        fflush(stdout);
+        return true;
+    } catch (const std::exception &error) {
+        fprintf(stderr, "replay %s on %s: %s\n", path.c_str(), backend.c_str(), error.what());
+        return false;
+    }
+}
+
+inline std::invalid_argument unsupported(const TraceRecord &record) {
+    return std::invalid_argument("operation " + std::to_string(record.operation) + " is not supported by this backend");
+}
+
+#endif
@@ -1,5 +1,23 @@
 #include<iostream>
 #include<vector>
+#include<random>
+#include<chrono>
+#include<string>
+#include<stdexcept>
+#include<cstdint>
+#include<climits>
+#include<list>
+#include<map>
+#include<unordered_map>
+#include<cstring>
+#include<cerrno>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#include "../Instrumentation/Instrumentation.h"
+#include "../Trace/Trace.h"
+#include "../Benchmark/Benchmark.h"
 
 using namespace std;
 
@@ -11,168 +29,653 @@ using namespace std;
     * It supports dynamic insertion of values and maintains a history of versions.
     * I called it VectorTree because it is desgned to work like a vector, but with a tree structure
     * to allow for efficient range queries and versioning.
+    * The tree can be saved to disk as a snapshot of all its nodes and roots, and every following version
+    * can be appended to a journal with a single write. Opening a snapshot only maps it, the nodes are
+    * read from the shared pages of the file, and the journal is replayed on top of it.
+    *
+    *   snapshot page 0:     SnapshotHeader (magic, number of nodes and versions, offsets of the arrays)
+    *   nodesOffset:         Node nodes[nodes]       the pool, padded to a whole slab
+    *   rootsOffset:         Root roots[versions]    the root of every version
+    *
+    *   journal:             JournalHeader, then for every version a JournalRecord and the nodes it created
 */
 
+const size_t pageSize = 4096; // Alignment of the nodes in the snapshot
+const char snapshotMagic[8] = {'V', 'E', 'C', 'T', 'R', 'E', 'E', '1'};
+const char journalMagic[8] = {'V', 'T', 'J', 'O', 'U', 'R', 'N', '1'};
+
+struct SnapshotHeader { // Structure of the first page of a snapshot
+    char magic[8];
+    uint32_t nodeSize; // Size of a node, to refuse a file written with another layout
+    uint32_t slabSize;
+    uint64_t nodes; // Number of nodes, a multiple of slabSize
+    uint64_t versions; // Number of roots
+    uint64_t nodesOffset, rootsOffset;
+    uint64_t fileSize;
+};
+
+struct JournalHeader {
+    char magic[8];
+    uint64_t firstVersion; // Version of the first record, the older ones are in the snapshot
+};
+
+struct JournalRecord { // A version, followed by the nodes it created
+    uint64_t checksum; // Checksum of the rest of the record and of its nodes, a torn write doesn't match it
+    uint32_t version;
+    uint32_t firstNode, nodeCount; // The nodes created by the version are [firstNode, firstNode + nodeCount)
+    uint32_t root;
+    int32_t level, count;
+};
+
+// Function to throw the error of the last system call
+void systemError(const string &what, const string &path) {
+    throw runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+// Function to write all the bytes of data, write can write only a part of them
+void writeAll(int fd, const void *data, size_t length, const string &path) {
+    const char *bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            systemError("cannot write", path);
+        }
+        bytes += written;
+        length -= written;
+    }
+}
+
 class VectorTree {
-    private:
-        // Node is the base class for both Leaf and Vertex
-        class Node {
-            public:
-                virtual ~Node() {}
+    public:
+        // Configuration of the prefix sums kept to answer GetSum in O(1)
+        struct CacheConfig {
+            bool keepLatest; // Keep the prefix sums of the newest version, extended by insert and append
+            bool updateLatest; // Apply set and add to them in O(n - start), otherwise they stay valid only for the older versions
+            size_t historyBytes; // Memory for the prefix sums of the older versions, the least recently used are dropped
+            int materializeAfter; // Number of queries on a version before its prefix sums are built in O(n), 0 for n / 16 + 2
+            CacheConfig(void) : keepLatest(true), updateLatest(false), historyBytes(64 << 20), materializeAfter(0) {}
         };
 
-        // Leaf represents a leaf node in the tree, which contains a value and its index
-        class Leaf : public Node {
-            public:
-                int index;  // Index of the leaf in the vector
-                int value;  // Value stored in the leaf
-                Leaf(int val) : Node(), value(val) {}
+        struct CacheStats {
+            long long latestHits, historyHits, misses;
+            long long materialized; // Number of prefix sums built
+            size_t bytes; // Memory of all the prefix sums
         };
-        // Vertex represents a vertex node in the tree, which contains a range and its value
-        class Vertex : public Node {
-            public:
-                Node* left; // Pointer to the left child
-                Node* right;    // Pointer to the right child
-                int range;  // Range of indices covered by this vertex
-                int start, end; // Start and end indices of the range
-                int value;
-                Vertex(void) : Node() , range(0), value(0), left(nullptr), right(nullptr) {}
+
+    private:
+        // Node is a leaf or a vertex: the nodes at depth level from the root of a version are the leaves, the others are vertices.
+        // A node doesn't store its range: the root of a version covers [0, 2^level) and every vertex splits its
+        // range in two halves, so the range of a node is computed from its depth and position on the way down.
+        // The value added to a range stays in the vertices that cover it (tag) and is not pushed to the children,
+        // so a node is never modified after it's created and the versions share the nodes that don't change.
+        struct Node {
+            uint32_t left, right; // Indices of the children in the pool, 0 is a missing child (only zeros)
+            int value; // Value of a leaf, sum of the range of a vertex with the tags of the vertex and below
+            int tag; // Value added to every element of the range of a vertex
+        };
+
+        struct Root { // Root of a version, it covers [0, 2^level)
+            uint32_t node;
+            int level;
+            int count; // Number of elements in the version
         };
 
-        vector <Node*> leaves;  // Vector to store all leaf nodes
-        vector <Node*> roots;   // Vector to store the roots of different versions of the tree
+        static const int slabBits = 16;
+        static const uint32_t slabSize = 1 << slabBits; // Number of nodes allocated together
+
+        vector <Node*> slabs;    // Pool of the nodes: node i is slabs[i / slabSize][i % slabSize], node 0 is the missing child
+        uint32_t allocated; // Number of nodes taken from the slabs
+        vector <Root> roots;   // Vector to store the roots of different versions of the tree
         int size;   // Current size of the tree
-        int node_number;    // Current number of nodes in the tree
+        int node_number;    // Current number of leaves in the tree
         int version;    // Current version of the tree
+        uint32_t firstFresh; // The nodes from this index are created by the current operation and can be modified
+        char *mapping; // Mapping of the snapshot the tree was opened from, its slabs come first and are never modified
+        size_t mappingLength;
+        size_t mappedSlabs;
+        int journal; // File where every new version is appended, -1 if there is none
+        string journalPath;
+
+        struct PrefixSums { // sums[i] is the sum of [0, i) in every version from first to last
+            int first, last;
+            long long hits; // Queries answered with them
+            vector <long long> sums;
+            PrefixSums(void) : first(0), last(-1), hits(0) {}
+        };
 
-        // Insert a value into the tree, creating new nodes as necessary
-        // The function is recursive and handles the insertion logic based on the current size and node number
-        void insert(int value, Node*& node, int start = 0, int end = -1) {
-            if (end == -1) {
-                end = size - 1;
+        bool cacheEnabled;
+        CacheConfig cacheConfig;
+        PrefixSums latest; // Prefix sums that end with the newest version, if last == version
+        list <PrefixSums> history; // Prefix sums of older versions, the most recently used first
+        map <int, list <PrefixSums>::iterator> historyIndex; // Entry of history for its last version
+        size_t historyUsed; // Memory of history
+        unordered_map <int, int> misses; // Queries without prefix sums for every older version
+        int latestMisses; // Queries without prefix sums on the versions after latest, since the last set or add
+        int latestPenalty; // Doublings of materializeAfter for latest, after writes made it old before it paid for itself
+        CacheStats stats;
+
+        Node &at(uint32_t index) {
+            return slabs[index >> slabBits][index & (slabSize - 1)];
+        }
+
+        const Node &at(uint32_t index) const {
+            return slabs[index >> slabBits][index & (slabSize - 1)];
+        }
+
+        // Function to get a node that can be modified: the node itself if it was created by this operation,
+        // otherwise a copy of it, so the nodes of the previous versions are never changed
+        uint32_t writable(uint32_t index) {
+            if (index >= firstFresh) return index;
+            TREE_COUNT("vector_tree_node_allocations");
+            if (allocated == UINT32_MAX) throw length_error("VectorTree: too many nodes");
+            if (allocated % slabSize == 0) slabs.push_back(new Node[slabSize]());
+            at(allocated) = at(index); // Node 0 has only zeros
+            return allocated++;
+        }
+
+        // Insert a value after the last element of root, copying only the nodes on the path to the new leaf
+        // When the tree is full, a new root with the old tree as left child doubles the size
+        Root insert(int value, Root root) {
+            if (node_number == size && node_number > 0) {
+                uint32_t created = writable(0);
+                at(created).left = root.node;
+                at(created).value = at(root.node).value;
+                root.node = created;
+                root.level++;
             }
 
-            if (size == 0) {
-                Node* newNode = new Leaf(value);
-                leaves.push_back(newNode);
-                static_cast<Leaf*>(newNode)->index = node_number;
-                node = newNode;
-                size = 1;
-                node_number = 1;
-                return;
+            root.node = writable(root.node);
+            uint32_t node = root.node;
+            for (int level = root.level; level > 0; level--) {
+                at(node).value += value;
+                uint32_t child;
+                if ((node_number >> (level - 1)) & 1) {
+                    child = writable(at(node).right);
+                    at(node).right = child;
+                } else {
+                    child = writable(at(node).left);
+                    at(node).left = child;
+                }
+                node = child;
             }
+            at(node).value = value;
 
-            if (node == nullptr) {
-                node = new Vertex();
-                roots.push_back(node);
+            node_number++;
+            size = 1 << root.level;
+            root.count = node_number;
+            return root;
+        }
+
+        // Value added by a tag to a range of 2^level elements, the sums are int like the values
+        static int scaled(int tag, int level) {
+            return (int)((unsigned)tag << level);
+        }
+
+        void recompute(uint32_t index, int level) {
+            Node &node = at(index);
+            node.value = at(node.left).value + at(node.right).value + scaled(node.tag, level);
+        }
+
+        // Add delta to [start, end] in the subtree of [lo, lo + 2^level), copying only the nodes on the paths
+        // to start and end: a vertex inside the range gets the tag and its children are shared
+        uint32_t add(uint32_t index, int start, int end, int delta, int level, long long lo) {
+            long long hi = lo + (1LL << level) - 1;
+            if (hi < start || lo > end) return index; // Out of range, shared with the previous version
+
+            uint32_t created = writable(index);
+            if (start <= lo && hi <= end) {
+                if (level > 0) at(created).tag += delta; // A leaf has no children, the value is enough
+                at(created).value += scaled(delta, level);
+                return created;
             }
+            uint32_t left = add(at(created).left, start, end, delta, level - 1, lo);
+            uint32_t right = add(at(created).right, start, end, delta, level - 1, lo + (1LL << (level - 1)));
+            at(created).left = left;
+            at(created).right = right;
+            recompute(created, level);
+            return created;
+        }
 
-            if (size == node_number){
-                Node* newNode = new Vertex();
-                size*=2;
-                end = size - 1;
-                static_cast<Vertex*>(newNode)->left = node;
-                node = newNode;
+        // Set the element at index to value, copying the nodes on its path: the leaf keeps the value without
+        // the tags of its ancestors, and every ancestor changes by the same difference
+        Root set(int index, int value, Root root) {
+            uint32_t path[32];
+            int tags = 0;
+            root.node = writable(root.node);
+            uint32_t node = root.node;
+            for (int level = root.level; level > 0; level--) {
+                path[level - 1] = node;
+                tags += at(node).tag;
+                uint32_t child;
+                if ((index >> (level - 1)) & 1) {
+                    child = writable(at(node).right);
+                    at(node).right = child;
+                } else {
+                    child = writable(at(node).left);
+                    at(node).left = child;
+                }
+                node = child;
             }
+            int difference = value - (at(node).value + tags);
+            at(node).value = value - tags;
+            for (int level = 0; level < root.level; level++) at(path[level]).value += difference;
+            return root;
+        }
 
-            if (start == end){
-                Node* newNode = new Leaf(value);
-                leaves.push_back(newNode);
-                static_cast<Leaf*>(newNode)->index = node_number++;
-                node = newNode;
-                return;
+        // Build the subtree of [lo, lo + 2^level) with the values from first to last, children before their parent
+        uint32_t build(const int *values, int first, int last, int level, long long lo) {
+            if (lo >= last) return 0; // Nothing after last
+            if (level == 0) {
+                uint32_t leaf = writable(0);
+                at(leaf).value = values[lo - first];
+                return leaf;
             }
+            uint32_t left = build(values, first, last, level - 1, lo);
+            uint32_t right = build(values, first, last, level - 1, lo + (1LL << (level - 1)));
+            uint32_t created = writable(0);
+            at(created).left = left;
+            at(created).right = right;
+            recompute(created, level);
+            return created;
+        }
 
-            int mid = (start + end) / 2;
-            if (node_number > mid) {
-                if (static_cast<Vertex*>(node)->right == nullptr) {
-                    static_cast<Vertex*>(node)->right = new Vertex();
-                }
-                insert(value, static_cast<Vertex*>(node)->right, mid + 1, end);
-            } else {
-                if (static_cast<Vertex*>(node)->left == nullptr) {
-                    static_cast<Vertex*>(node)->left = new Vertex();
+        // Put the values from first to last in the subtree of [lo, lo + 2^level): the subtrees after first are built new,
+        // the ones before are shared and only the nodes on the path to first are copied
+        uint32_t append(uint32_t index, const int *values, int first, int last, int level, long long lo) {
+            long long hi = lo + (1LL << level);
+            if (hi <= first || lo >= last) return index; // Untouched, shared with the previous version
+            if (lo >= first) return build(values, first, last, level, lo); // Only new values, there is no old node
+
+            uint32_t created = writable(index);
+            uint32_t left = append(at(created).left, values, first, last, level - 1, lo);
+            uint32_t right = append(at(created).right, values, first, last, level - 1, lo + (1LL << (level - 1)));
+            at(created).left = left;
+            at(created).right = right;
+            recompute(created, level);
+            return created;
+        }
+
+        // Insert count values after the last element of root, in O(count + log n) nodes
+        Root append(const int *values, int count, Root root) {
+            if (count > INT_MAX - node_number) throw length_error("VectorTree: too many values");
+            int first = node_number, last = node_number + count;
+            while ((1LL << root.level) < last) { // Double the size until the values fit
+                if (root.node) {
+                    uint32_t created = writable(0);
+                    at(created).left = root.node;
+                    at(created).value = at(root.node).value;
+                    root.node = created;
                 }
-                insert(value, static_cast<Vertex*>(node)->left, start, mid);
+                root.level++;
             }
+            root.node = append(root.node, values, first, last, root.level, 0);
 
-            Vertex* vertex = static_cast<Vertex*>(node);
+            node_number = last;
+            if (node_number > 0) size = 1 << root.level;
+            root.count = node_number;
+            return root;
+        }
 
-            if (vertex->left) {
-                if (dynamic_cast<Leaf*>(vertex->left)) {
-                    vertex->value += static_cast<Leaf*>(vertex->left)->value;
+        // Get the sum of the values in [0, end) for a version, walking down the path of end
+        // The tags of the vertices on the path are added to the halves they cover
+        long long prefix(Root root, long long end) const {
+            if (end >= (1LL << root.level)) return at(root.node).value; // The whole version
+            long long sum = 0, tags = 0;
+            uint32_t node = root.node;
+            for (int level = root.level; level > 0 && node; level--) {
+                TREE_COUNT("vector_tree_getsum_nodes");
+                tags += at(node).tag;
+                if ((end >> (level - 1)) & 1) {
+                    sum += at(at(node).left).value + tags * (1LL << (level - 1)); // The left half is all before end
+                    node = at(node).right;
                 } else {
-                    vertex->value += static_cast<Vertex*>(vertex->left)->value;
+                    node = at(node).left;
                 }
             }
-            if (vertex->right) {
-                if (dynamic_cast<Leaf*>(vertex->right)) {
-                    vertex->value += static_cast<Leaf*>(vertex->right)->value;
-                } else {
-                    vertex->value += static_cast<Vertex*>(vertex->right)->value;
-                }
+            return sum;
+        }
+
+        // Checksum of a block of bytes (FNV-1a on 8 bytes at a time), the records are multiples of 8 bytes
+        static uint64_t checksum(const char *data, size_t length, uint64_t hash = 14695981039346656037ULL) {
+            for (size_t i = 0; i + 8 <= length; i += 8) {
+                uint64_t word;
+                memcpy(&word, data + i, 8);
+                hash = (hash ^ word) * 1099511628211ULL;
             }
+            return hash;
+        }
 
-            vertex->start = start;
-            vertex->end = end;
-            vertex->range = end - start + 1;
+        // Function to append the last version to the journal: the record and its nodes are one write
+        void logVersion(void) {
+            if (journal < 0) return;
+            JournalRecord record;
+            record.version = version;
+            record.firstNode = firstFresh;
+            record.nodeCount = allocated - firstFresh;
+            record.root = roots[version].node;
+            record.level = roots[version].level;
+            record.count = roots[version].count;
 
+            vector <char> buffer(sizeof(record) + (size_t)record.nodeCount * sizeof(Node));
+            char *nodes = buffer.data() + sizeof(record);
+            for (uint32_t i = 0; i < record.nodeCount; i++) memcpy(nodes + i * sizeof(Node), &at(firstFresh + i), sizeof(Node));
+            record.checksum = checksum(reinterpret_cast<const char*>(&record) + 8, sizeof(record) - 8);
+            record.checksum = checksum(nodes, buffer.size() - sizeof(record), record.checksum);
+            memcpy(buffer.data(), &record, sizeof(record));
+            writeAll(journal, buffer.data(), buffer.size(), journalPath);
         }
 
-        // Get the sum of values in the specified range [start, end] for a given version of the tree
-        // The function traverses the tree recursively to find the sum of values in the specified range
-        int GetSum(Node* node, int start, int end) {
-            if (node == nullptr || start > end) {
-                return 0;
-            }
-            
-            Vertex* vertex = static_cast<Vertex*>(node);
-
-            if (dynamic_cast<Leaf*>(node)) {
-                Leaf* leaf = static_cast<Leaf*>(node);
-                if (leaf->index >= start && leaf->index <= end) {
-                    return leaf->value;
-                } else {
-                    return 0;
+        void addVersion(Root root) {
+            TREE_COUNT("vector_tree_versions");
+            roots.push_back(root);
+            version++;
+            node_number = root.count;
+            size = root.count > 0 ? 1 << root.level : 0;
+            logVersion();
+        }
+
+        // Function to empty the journal, the next record is the next version
+        void startJournal(int fd, const string &path) {
+            padToSlab();
+            JournalHeader header;
+            memcpy(header.magic, journalMagic, sizeof(journalMagic));
+            header.firstVersion = roots.size();
+            if (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0) systemError("cannot truncate", path);
+            writeAll(fd, &header, sizeof(header), path);
+            if (fsync(fd) < 0) systemError("cannot sync", path);
+        }
+
+        // Function to add the versions of the journal to the tree, it reads the journal through a mapping
+        void replay(int fd, size_t length, const string &path) {
+            void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) systemError("cannot map", path);
+            const char *data = static_cast<const char*>(mapped);
+            const JournalHeader *header = reinterpret_cast<const JournalHeader*>(data);
+            if (memcmp(header->magic, journalMagic, sizeof(journalMagic)) != 0 || header->firstVersion > roots.size()) {
+                munmap(mapped, length);
+                throw runtime_error("not a journal of this tree: " + path);
+            }
+
+            size_t offset = sizeof(JournalHeader);
+            while (offset + sizeof(JournalRecord) <= length) {
+                JournalRecord record;
+                memcpy(&record, data + offset, sizeof(record));
+                size_t nodesLength = (size_t)record.nodeCount * sizeof(Node);
+                if (nodesLength > length - offset - sizeof(record)) break; // Torn record
+                const char *nodes = data + offset + sizeof(record);
+                uint64_t expected = checksum(reinterpret_cast<const char*>(&record) + 8, sizeof(record) - 8);
+                if (checksum(nodes, nodesLength, expected) != record.checksum) break; // Torn or corrupted record
+
+                if (record.version >= roots.size()) { // The older ones are in the snapshot already
+                    if (record.version != roots.size() || record.firstNode < allocated || record.firstNode + (uint64_t)record.nodeCount > UINT32_MAX) {
+                        munmap(mapped, length);
+                        throw runtime_error("the journal doesn't follow the snapshot: " + path);
+                    }
+                    // A record can start on a new slab, after a save or when the journal was opened
+                    while ((uint64_t)slabs.size() * slabSize < (uint64_t)record.firstNode + record.nodeCount) slabs.push_back(new Node[slabSize]());
+                    for (uint32_t i = 0; i < record.nodeCount; i++) memcpy(&at(record.firstNode + i), nodes + i * sizeof(Node), sizeof(Node));
+                    allocated = record.firstNode + record.nodeCount;
+                    firstFresh = allocated;
+                    addVersion(Root{record.root, record.level, record.count}); // The journal is not open yet, nothing is written
                 }
+                offset += sizeof(record) + nodesLength;
+            }
+            munmap(mapped, length);
+
+            if (offset < length && ftruncate(fd, offset) < 0) systemError("cannot truncate", path); // Remove the torn tail
+            if (lseek(fd, offset, SEEK_SET) < 0) systemError("cannot seek", path);
+        }
+
+        // Function to compute the prefix sums of a version, walking its leaves in order
+        void materialize(uint32_t node, int level, long long tags, int count, vector <long long> &sums) const {
+            if ((int)sums.size() > count) return; // After the last element
+            if (level == 0) {
+                sums.push_back(sums.back() + tags + at(node).value);
+                return;
+            }
+            tags += at(node).tag;
+            materialize(at(node).left, level - 1, tags, count, sums);
+            materialize(at(node).right, level - 1, tags, count, sums);
+        }
+
+        static size_t bytes(const PrefixSums &prefix) {
+            return prefix.sums.capacity() * sizeof(long long);
+        }
+
+        void forget(list <PrefixSums>::iterator entry) {
+            historyUsed -= bytes(*entry);
+            historyIndex.erase(entry->last);
+            history.erase(entry);
+        }
+
+        // Function to keep prefix sums of older versions, dropping the least recently used ones over the memory limit
+        void remember(PrefixSums &&prefix) {
+            if (bytes(prefix) > cacheConfig.historyBytes) return;
+            auto same = historyIndex.find(prefix.last);
+            if (same != historyIndex.end()) forget(same->second);
+            historyUsed += bytes(prefix);
+            history.push_front(move(prefix));
+            historyIndex[history.front().last] = history.begin();
+            while (historyUsed > cacheConfig.historyBytes) forget(prev(history.end()));
+        }
+
+        // Number of queries that pay the construction of the prefix sums of count elements: a query walks
+        // two paths of the tree, building the prefix sums visits every node once, measured at 10 to 25 queries
+        // for every 256 elements
+        int materializeAfter(int count) const {
+            return cacheConfig.materializeAfter > 0 ? cacheConfig.materializeAfter : count / 16 + 2;
+        }
+
+        PrefixSums build(int Version) const {
+            Root root = roots[Version];
+            PrefixSums prefix;
+            prefix.first = prefix.last = Version;
+            prefix.sums.reserve(root.count + 1);
+            prefix.sums.push_back(0);
+            if (root.count > 0) materialize(root.node, root.level, 0, root.count, prefix.sums);
+            return prefix;
+        }
+
+        // Function to find the prefix sums of a version, they are built after materializeAfter queries without them.
+        // The queries on the versions after latest count together, because the newest version changes at every append,
+        // but a set or an add starts the count again: latest built before it would not answer the queries after it.
+        const PrefixSums *cached(int Version) {
+            if (!latest.sums.empty() && Version >= latest.first && Version <= latest.last) {
+                stats.latestHits++;
+                latest.hits++;
+                return &latest;
+            }
+            auto entry = historyIndex.lower_bound(Version); // The first prefix sums that end at Version or after it
+            if (entry != historyIndex.end() && entry->second->first <= Version) {
+                history.splice(history.begin(), history, entry->second); // Most recently used, the iterator stays valid
+                stats.historyHits++;
+                history.front().hits++;
+                return &history.front();
             }
 
-            if (start <= vertex->start && end >= vertex->end) {
-                return vertex->value;
+            stats.misses++;
+            if (cacheConfig.keepLatest && (latest.sums.empty() || Version > latest.last)) {
+                if (++latestMisses < (long long)materializeAfter(roots[version].count) << latestPenalty) return nullptr;
+                latestMisses = 0;
+                if (latest.hits > 0) remember(move(latest)); // Still right for its versions, kept only if it was used
+                latest = build(version);
+                stats.materialized++;
+                return Version == version ? &latest : nullptr;
             }
-            if (start > vertex->end || end < vertex->start) {
-                return 0;
+
+            if (misses.size() > 4096) misses.clear(); // Don't count the queries on too many versions
+            if (++misses[Version] < materializeAfter(roots[Version].count)) return nullptr;
+            misses.erase(Version);
+            remember(build(Version));
+            stats.materialized++;
+            return history.empty() || history.front().last != Version ? nullptr : &history.front();
+        }
+
+        // Function to extend the prefix sums of the newest version with the values of an insert or an append
+        void extendLatest(const int *values, int count) {
+            if (!cacheEnabled || latest.sums.empty() || latest.last != version - 1) return;
+            for (int i = 0; i < count; i++) latest.sums.push_back(latest.sums.back() + values[i]);
+            latest.last = version;
+        }
+
+        // Function to apply add(start, end, delta) to the prefix sums of the newest version, set is a range of one element
+        void updateLatest(int start, int end, long long delta) {
+            if (!cacheEnabled) return;
+            if (!cacheConfig.updateLatest) {
+                latestMisses = 0; // The queries before the write don't make latest useful after it
+                if (!latest.sums.empty() && latest.last == version - 1) { // The write makes latest old
+                    bool paid = latest.hits >= materializeAfter(latest.sums.size() - 1);
+                    latestPenalty = paid ? 0 : min(latestPenalty + 1, 16);
+                }
             }
+            if (!cacheConfig.updateLatest || latest.sums.empty() || latest.last != version - 1) return;
+            for (int i = start; i < (int)latest.sums.size() - 1; i++) latest.sums[i + 1] += delta * (min(i, end) - start + 1);
+            latest.first = latest.last = version; // The older versions don't have the update
+        }
 
-            return GetSum(vertex->left, start, end) + GetSum(vertex->right, start, end);
+        // Function to start the next operation on a new slab, so the node indices of a saved tree are the same
+        // when it's opened again: the snapshot pads the nodes to a whole slab
+        void padToSlab(void) {
+            if (allocated % slabSize) allocated = (allocated / slabSize + 1) * slabSize;
         }
 
     public:
 
         // Constructor to initialize the VectorTree with an empty tree or with a vector of values
-        // It initializes the size, node_number, and version, and sets the root to nullptr
-        VectorTree(void) : size(0), node_number(0), version(0) {roots.push_back(nullptr);}
-        VectorTree(vector <int> values) : size(0), node_number(0), version(0) {
-            roots.push_back(nullptr);
-            for (int val : values) {
-                insert(val, roots[0]);
+        // It initializes the size, node_number, and version, and sets the root of version 0
+        VectorTree(void) : allocated(1), size(0), node_number(0), version(0), firstFresh(1),
+            mapping(nullptr), mappingLength(0), mappedSlabs(0), journal(-1), cacheEnabled(false), historyUsed(0), latestMisses(0), latestPenalty(0), stats() {
+            slabs.push_back(new Node[slabSize]());
+            roots.push_back(Root{0, 0, 0});
+        }
+        VectorTree(vector <int> values) : VectorTree() {
+            if (values.size() > (size_t)INT_MAX) throw length_error("VectorTree: too many values");
+            roots[0] = append(values.data(), (int)values.size(), roots[0]); // All the nodes are new
+        }
+
+        /*
+            * Constructor to open a snapshot written by save, in O(1): the file is mapped and its slabs
+            * are used in place, so the pages are read only when a query needs them and are shared by
+            * the processes that open the same snapshot. Only the roots are copied.
+        */
+        explicit VectorTree(const string &path) : allocated(0), size(0), node_number(0), version(0), firstFresh(0),
+            mapping(nullptr), mappingLength(0), mappedSlabs(0), journal(-1), cacheEnabled(false), historyUsed(0), latestMisses(0), latestPenalty(0), stats() {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) systemError("cannot open", path);
+            struct stat info;
+            if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+                close(fd);
+                throw runtime_error("not a vector tree snapshot: " + path);
             }
+            mappingLength = info.st_size;
+            void *mapped = mmap(nullptr, mappingLength, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd); // The mapping keeps the file
+            if (mapped == MAP_FAILED) systemError("cannot map", path);
+            mapping = static_cast<char*>(mapped);
+
+            const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader*>(mapping);
+            if (memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) != 0 || header->nodeSize != sizeof(Node)
+                || header->slabSize != slabSize || header->fileSize != mappingLength || header->versions == 0
+                || header->nodes == 0 || header->nodes % slabSize != 0 || header->nodes > UINT32_MAX
+                || header->nodesOffset % pageSize != 0 || header->nodesOffset + header->nodes * sizeof(Node) > mappingLength
+                || header->rootsOffset + header->versions * sizeof(Root) > mappingLength || header->versions > (uint64_t)INT_MAX + 1) {
+                munmap(mapping, mappingLength);
+                throw runtime_error("not a valid vector tree snapshot: " + path);
+            }
+            madvise(mapping, mappingLength, MADV_RANDOM); // A query reads a few nodes, reading ahead would load pages not needed
+
+            // The nodes of the snapshot are never written: the next operation starts after them
+            Node *nodes = reinterpret_cast<Node*>(mapping + header->nodesOffset);
+            for (uint64_t i = 0; i < header->nodes; i += slabSize) slabs.push_back(nodes + i);
+            mappedSlabs = slabs.size();
+            allocated = firstFresh = header->nodes;
+            roots.resize(header->versions);
+            memcpy(roots.data(), mapping + header->rootsOffset, header->versions * sizeof(Root));
+            version = roots.size() - 1;
+            node_number = roots.back().count;
+            size = node_number > 0 ? 1 << roots.back().level : 0;
         }
 
+        ~VectorTree(void) {
+            for (size_t i = mappedSlabs; i < slabs.size(); i++) delete[] slabs[i];
+            if (mapping) munmap(mapping, mappingLength);
+            if (journal >= 0) close(journal);
+        }
+
+        VectorTree(const VectorTree&) = delete;
+        VectorTree &operator=(const VectorTree&) = delete;
+
         // Insert a value into the tree, creating a new version of the tree
         // It increments the version and pushes a new root to the roots vector
         void insert(int value) {
-            version++;
-            roots.push_back(roots.back());
-            insert(value, roots[version]);
+            TREE_RECORD(TRACE_APPEND, value);
+            TREE_TIME("vector_tree_insert");
+            firstFresh = allocated;
+            addVersion(insert(value, roots[version]));
+            extendLatest(&value, 1);
+        }
+
+        // Insert a block of values into the tree, creating a single new version of the tree
+        // Only the nodes on the path to the first new value are copied, the others are shared or built new
+        void append(const int *values, size_t count) {
+            if (count > (size_t)INT_MAX) throw length_error("VectorTree: too many values");
+            TREE_RECORD_BLOCK(values, count);
+            TREE_TIME("vector_tree_append");
+            firstFresh = allocated;
+            addVersion(append(values, (int)count, roots[version]));
+            extendLatest(values, count);
         }
 
-        // Get the value at a specific index in the leaves vector
-        int getValue(int index) {
-            if (index < 0 || index >= leaves.size()) {
+        void append(const vector <int> &values) {
+            append(values.data(), values.size());
+        }
+
+        // Set the element at index to value, creating a new version of the tree
+        void set(int index, int value) {
+            if (index < 0 || index >= node_number) {
                 throw out_of_range("Index out of range");
             }
-            return static_cast<Leaf*>(leaves[index])->value;
+            TREE_RECORD(TRACE_SET, index, value);
+            TREE_TIME("vector_tree_set");
+            long long difference = cacheEnabled && cacheConfig.updateLatest ? (long long)value - getValue(index) : 0;
+            firstFresh = allocated;
+            addVersion(set(index, value, roots[version]));
+            updateLatest(index, index, difference);
+        }
+
+        // Add delta to every element in [start, end], creating a new version of the tree
+        void add(int start, int end, int delta) {
+            if (start < 0 || end >= node_number || start > end) {
+                throw out_of_range("Range out of bounds");
+            }
+            TREE_RECORD(TRACE_UPDATE, start, end, delta);
+            TREE_TIME("vector_tree_add");
+            firstFresh = allocated;
+            Root root = roots[version];
+            root.node = add(root.node, start, end, delta, root.level, 0);
+            addVersion(root);
+            updateLatest(start, end, delta);
+        }
+
+        // Get the value at a specific index of a version, by default the current one
+        // It walks down the path of index and adds the tags of the vertices on the way
+        int getValue(int index, int Version = -1) {
+            if (Version == -1) Version = version;
+            if (Version < 0 || Version > version) {
+                throw out_of_range("Version out of range");
+            }
+            Root root = roots[Version];
+            if (index < 0 || index >= root.count) {
+                throw out_of_range("Index out of range");
+            }
+            int value = 0;
+            uint32_t node = root.node;
+            for (int level = root.level; level > 0; level--) {
+                value += at(node).tag;
+                node = (index >> (level - 1)) & 1 ? at(node).right : at(node).left;
+            }
+            return value + at(node).value;
         }
 
         // Getters for size, node_number, version, and sum of values in a specified range
@@ -180,7 +683,7 @@ class VectorTree {
             return size;
         }
 
-        // Get the number of nodes in the tree
+        // Get the number of leaves in the tree
         int GetNodeNumber(void) {
             return node_number;
         }
@@ -191,7 +694,11 @@ class VectorTree {
         }
 
         // Get the sum of values in the specified range [start, end] for a given version of the tree
+        // It's the difference of two prefix sums, every one is a single walk from the root without recursion
         int GetSum (int Version, int start, int end) {
+            if (Version == version) { TREE_RECORD(TRACE_SUM, start, end); }
+            else { TREE_RECORD(TRACE_VERSION_SUM, Version, start, end); }
+            TREE_TIME("vector_tree_getsum");
             if (Version < 0 || Version > version) {
                 throw out_of_range("Version out of range");
             }
@@ -199,16 +706,409 @@ class VectorTree {
                 throw out_of_range("Range out of bounds");
             }
 
-            Node* node = roots[Version];
-            return GetSum(node, start, end);
+            Root root = roots[Version];
+            if (cacheEnabled) {
+                const PrefixSums *prefix = cached(Version);
+                if (prefix) { // The prefix sums can be longer than the version, after its last element there are only zeros
+                    if (start >= root.count) return 0;
+                    return (int)(prefix->sums[min(end, root.count - 1) + 1] - prefix->sums[start]);
+                }
+            }
+            return (int)(prefix(root, (long long)end + 1) - prefix(root, start));
+        }
+
+        /*
+            * Function to answer GetSum with prefix sums: the ones of the newest version are extended by every
+            * insert and append, and the ones of the older versions that are queried often are kept in an LRU.
+            * A version gets its prefix sums after config.materializeAfter queries, so a version queried once
+            * doesn't cost O(n).
+        */
+        void EnableCache(const CacheConfig &config = CacheConfig()) {
+            DisableCache();
+            cacheEnabled = true;
+            cacheConfig = config;
+        }
+
+        void DisableCache(void) {
+            cacheEnabled = false;
+            latest = PrefixSums();
+            history.clear();
+            historyIndex.clear();
+            historyUsed = 0;
+            misses.clear();
+            latestMisses = 0;
+            latestPenalty = 0;
+        }
+
+        CacheStats GetCacheStats(void) const {
+            CacheStats result = stats;
+            result.bytes = bytes(latest) + historyUsed;
+            return result;
+        }
+
+        /*
+            * Function to write all the versions to a snapshot at path.
+            * The file is written next to path and renamed, so a crash leaves the old snapshot.
+            * The journal, if there is one, is emptied: its versions are in the snapshot now.
+        */
+        void save(const string &path) {
+            SnapshotHeader header;
+            memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+            header.nodeSize = sizeof(Node);
+            header.slabSize = slabSize;
+            header.nodes = (uint64_t)slabs.size() * slabSize; // The last slab is written whole
+            header.versions = roots.size();
+            header.nodesOffset = pageSize;
+            header.rootsOffset = header.nodesOffset + header.nodes * sizeof(Node);
+            header.fileSize = header.rootsOffset + header.versions * sizeof(Root);
+
+            string temporary = path + ".tmp";
+            int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) systemError("cannot create", temporary);
+            try {
+                vector <char> page(pageSize, 0);
+                memcpy(page.data(), &header, sizeof(header));
+                writeAll(fd, page.data(), page.size(), temporary);
+                for (size_t i = 0; i < slabs.size(); i++) writeAll(fd, slabs[i], slabSize * sizeof(Node), temporary);
+                writeAll(fd, roots.data(), roots.size() * sizeof(Root), temporary);
+                if (fsync(fd) < 0) systemError("cannot sync", temporary);
+            } catch (...) {
+                close(fd);
+                unlink(temporary.c_str());
+                throw;
+            }
+            close(fd);
+            if (rename(temporary.c_str(), path.c_str()) < 0) systemError("cannot rename", temporary);
+
+            padToSlab(); // Same node indices as a tree opened from the snapshot
+            if (journal >= 0) startJournal(journal, journalPath);
+        }
+
+        /*
+            * Function to append every new version to the journal at path.
+            * The versions already in the journal after the ones of the tree are replayed first. A record that
+            * was not written completely (a crash during the write) doesn't match its checksum: the journal
+            * is truncated there and the next versions are written after the last complete one.
+        */
+        void openJournal(const string &path) {
+            if (journal >= 0) throw logic_error("VectorTree: the journal is already open");
+            int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd < 0) systemError("cannot open", path);
+            try {
+                struct stat info;
+                if (fstat(fd, &info) < 0) systemError("cannot read", path);
+                if ((size_t)info.st_size < sizeof(JournalHeader)) {
+                    startJournal(fd, path); // New journal
+                } else {
+                    replay(fd, info.st_size, path);
+                }
+            } catch (...) {
+                close(fd);
+                throw;
+            }
+            journal = fd;
+            journalPath = path;
+        }
+
+        // Function to wait until the versions appended to the journal are on the disk
+        void sync(void) {
+            if (journal >= 0 && fdatasync(journal) < 0) systemError("cannot sync", journalPath);
+        }
+
+        // Memory used by the nodes and the roots
+        size_t memoryUsage(void) const {
+            return slabs.size() * slabSize * sizeof(Node) + roots.capacity() * sizeof(Root);
         }
 
 };
 
+// Append n random values, one version each, then query random ranges of random versions
+void benchmarkVector(int n) {
+    mt19937 rng(42);
+    vector <int> values(n);
+    vector <long long> prefix(n + 1, 0);
+    for (int i = 0; i < n; i++) {
+        values[i] = (int)(rng() % 1000);
+        prefix[i + 1] = prefix[i] + values[i];
+    }
+
+    VectorTree tree;
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) tree.insert(values[i]);
+    auto inserted = chrono::steady_clock::now();
+
+    const int queries = 1000000;
+    int errors = 0;
+    long long checksum = 0;
+    auto checked = chrono::steady_clock::now();
+    for (int i = 0; i < queries; i++) {
+        int version = rng() % (n + 1); // Version v contains the first v values
+        int start = rng() % n, end = start + rng() % (n - start);
+        int sum = tree.GetSum(version, start, end);
+        checksum += sum;
+        if (sum != (start < version ? prefix[min(end + 1, version)] - prefix[start] : 0)) errors++;
+    }
+    auto queried = chrono::steady_clock::now();
+
+    double insertSeconds = chrono::duration<double>(inserted - begin).count();
+    double querySeconds = chrono::duration<double>(queried - checked).count();
+    cout << "n = " << n << endl;
+    cout << "  append: " << insertSeconds * 1e9 / n << " ns per value, 1e6 range sums of random versions: "
+         << querySeconds * 1e9 / queries << " ns per query, " << (errors == 0 ? "right sums" : "WRONG SUMS")
+         << " (" << errors << " errors, checksum " << checksum << ")" << endl;
+    cout << "  memory: " << tree.memoryUsage() / 1048576.0 << " MB (" << (double)tree.memoryUsage() / n << " bytes per value)" << endl;
+}
+
+// Append n values one at a time and in blocks, one version per block, and check the sums of the block versions
+void benchmarkAppend(int n, int block) {
+    mt19937 rng(7);
+    vector <int> values(n);
+    vector <long long> prefix(n + 1, 0);
+    for (int i = 0; i < n; i++) {
+        values[i] = (int)(rng() % 100); // The sums of 1e7 values still fit in an int
+        prefix[i + 1] = prefix[i] + values[i];
+    }
+
+    VectorTree single;
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) single.insert(values[i]);
+    auto inserted = chrono::steady_clock::now();
+
+    VectorTree blocks;
+    for (int i = 0; i < n; i += block) blocks.append(values.data() + i, min(block, n - i));
+    auto appended = chrono::steady_clock::now();
+
+    int errors = 0;
+    for (int i = 0; i < 100000; i++) {
+        int version = rng() % blocks.GetVersion(); // Version v contains the first v blocks
+        int count = min((long long)version * block, (long long)n);
+        int start = rng() % n, end = start + rng() % (n - start);
+        if (blocks.GetSum(version, start, end) != (start < count ? prefix[min(end + 1, count)] - prefix[start] : 0)) errors++;
+    }
+
+    cout << "n = " << n << ", blocks of " << block << ": " << (errors == 0 ? "right sums" : "WRONG SUMS") << endl;
+    cout << "  insert: " << chrono::duration<double>(inserted - begin).count() * 1e9 / n << " ns and "
+         << (double)single.memoryUsage() / n << " bytes per value" << endl;
+    cout << "  append: " << chrono::duration<double>(appended - inserted).count() * 1e9 / n << " ns and "
+         << (double)blocks.memoryUsage() / n << " bytes per value" << endl;
+}
+
+// Run random set and add on n values, one version each, and measure the time and the memory per update
+void benchmarkUpdates(int n, int updates) {
+    mt19937 rng(11);
+    vector <int> values(n);
+    for (int &value : values) value = (int)(rng() % 100);
+    VectorTree tree(values);
+    long long total = 0;
+    for (int value : values) total += value;
+
+    size_t memory = tree.memoryUsage();
+    double setSeconds = 0, addSeconds = 0;
+    int sets = 0;
+    for (int i = 0; i < updates; i++) {
+        if (i % 2 == 0) {
+            int index = rng() % n, value = (int)(rng() % 100);
+            total += value - tree.getValue(index);
+            auto begin = chrono::steady_clock::now();
+            tree.set(index, value);
+            setSeconds += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+            sets++;
+        } else {
+            int start = rng() % n, end = start + rng() % (n - start), delta = (int)(rng() % 7) - 3;
+            total += (long long)delta * (end - start + 1);
+            auto begin = chrono::steady_clock::now();
+            tree.add(start, end, delta);
+            addSeconds += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        }
+    }
+
+    cout << "n = " << n << ", updates = " << updates << ": "
+         << (tree.GetSum(tree.GetVersion() - 1, 0, n - 1) == (int)total ? "right sum" : "WRONG SUM") << endl;
+    cout << "  set: " << setSeconds * 1e9 / sets << " ns, add: " << addSeconds * 1e9 / (updates - sets) << " ns, "
+         << (double)(tree.memoryUsage() - memory) / updates << " bytes per update" << endl;
+}
+
+// Save n values in blocks of 1000 (one version each) to a snapshot, journal more versions, then open and recover the files
+void benchmarkPersistence(int n, int versions, const string &path) {
+    mt19937 rng(13);
+    string snapshot = path + ".snapshot", journal = path + ".journal";
+    unlink(journal.c_str());
+    long long checksum = 0;
+    double saveSeconds, journalSeconds;
+    {
+        VectorTree tree;
+        vector <int> block(1000);
+        for (int i = 0; i < n; i += 1000) {
+            for (int &value : block) value = (int)(rng() % 100);
+            tree.append(block.data(), min(1000, n - i));
+        }
+        auto begin = chrono::steady_clock::now();
+        tree.save(snapshot);
+        saveSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+        tree.openJournal(journal);
+        begin = chrono::steady_clock::now();
+        for (int i = 0; i < versions; i++) {
+            int start = rng() % n, end = start + rng() % (n - start);
+            if (i % 2) tree.add(start, end, (int)(rng() % 7) - 3);
+            else tree.set(start, (int)(rng() % 100));
+        }
+        tree.sync();
+        journalSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        for (int v = 0; v < tree.GetVersion(); v += 97) checksum += tree.GetSum(v, 0, tree.GetSize() - 1);
+    }
+
+    auto begin = chrono::steady_clock::now();
+    VectorTree opened(snapshot);
+    double openSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    begin = chrono::steady_clock::now();
+    opened.openJournal(journal);
+    double replaySeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    long long reopened = 0;
+    for (int v = 0; v < opened.GetVersion(); v += 97) reopened += opened.GetSum(v, 0, opened.GetSize() - 1);
+    int last = opened.GetVersion();
+
+    struct stat info;
+    stat(journal.c_str(), &info);
+    if (truncate(journal.c_str(), info.st_size - 5) < 0) systemError("cannot truncate", journal); // Tear the last record
+    VectorTree recovered(snapshot);
+    recovered.openJournal(journal);
+
+    stat(snapshot.c_str(), &info);
+    cout << "n = " << n << ", " << versions << " journaled versions: " << (checksum == reopened ? "same sums" : "DIFFERENT SUMS")
+         << ", torn tail " << (recovered.GetVersion() == last - 1 ? "recovered" : "NOT RECOVERED") << endl;
+    cout << "  save: " << saveSeconds << " s (" << info.st_size / 1048576.0 << " MB), journal: "
+         << journalSeconds * 1e6 / versions << " us per version" << endl;
+    cout << "  open: " << openSeconds * 1e3 << " ms, replay: " << replaySeconds * 1e3 << " ms" << endl;
+    unlink(snapshot.c_str());
+    unlink(journal.c_str());
+}
+
+// Append blocks to n values while querying: 90% of the queries go to the newest 4 versions, with and without the cache
+void benchmarkCache(int n, int rounds) {
+    long long checksums[2];
+    for (int cached = 0; cached < 2; cached++) {
+        mt19937 rng(17);
+        VectorTree tree;
+        vector <int> block(1000);
+        for (int i = 0; i < n; i += 1000) {
+            for (int &value : block) value = (int)(rng() % 100);
+            tree.append(block.data(), min(1000, n - i));
+        }
+        if (cached) tree.EnableCache();
+
+        long long checksum = 0;
+        double appendSeconds = 0, querySeconds = 0;
+        for (int round = 0; round < rounds; round++) {
+            for (int i = 0; i < 100; i++) block[i] = (int)(rng() % 100);
+            auto begin = chrono::steady_clock::now();
+            tree.append(block.data(), 100);
+            auto appended = chrono::steady_clock::now();
+            for (int i = 0; i < 1000; i++) {
+                int last = tree.GetVersion() - 1;
+                int version = rng() % 10 ? last - (int)(rng() % 4) : (int)(rng() % (last + 1));
+                int start = rng() % tree.GetNodeNumber(), end = start + rng() % (tree.GetNodeNumber() - start);
+                checksum += tree.GetSum(version, start, end);
+            }
+            appendSeconds += chrono::duration<double>(appended - begin).count();
+            querySeconds += chrono::duration<double>(chrono::steady_clock::now() - appended).count();
+        }
+        checksums[cached] = checksum;
+
+        cout << (cached ? "  with cache:    " : "  without cache: ") << querySeconds * 1e9 / (rounds * 1000.0) << " ns per query, "
+             << appendSeconds * 1e6 / rounds << " us per append of 100 values";
+        if (cached) {
+            VectorTree::CacheStats stats = tree.GetCacheStats();
+            cout << ", " << stats.latestHits << " + " << stats.historyHits << " hits, " << stats.misses << " misses, "
+                 << stats.materialized << " built, " << stats.bytes / 1048576.0 << " MB";
+        }
+        cout << endl;
+    }
+    cout << "  " << (checksums[0] == checksums[1] ? "same sums" : "DIFFERENT SUMS") << endl;
+}
+
+// Alternate set and add with a GetSum on the newest version: every write makes a new version, so the cache
+// should not build prefix sums that the next write makes old, and must not be slower than no cache
+void benchmarkCacheWrites(int n, int operations) {
+    long long checksums[2];
+    double seconds[2];
+    for (int cached = 0; cached < 2; cached++) {
+        mt19937 rng(23);
+        vector <int> values(n);
+        for (int &value : values) value = (int)(rng() % 100);
+        VectorTree tree(values);
+        if (cached) tree.EnableCache();
+
+        long long checksum = 0;
+        auto begin = chrono::steady_clock::now();
+        for (int i = 0; i < operations; i++) {
+            int start = rng() % n, end = start + rng() % (n - start);
+            if (i % 4 == 0) tree.add(start, end, 1);
+            else if (i % 2 == 0) tree.set(start, (int)(rng() % 100));
+            else checksum += tree.GetSum(tree.GetVersion() - 1, start, end);
+        }
+        seconds[cached] = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        checksums[cached] = checksum;
+
+        cout << (cached ? "  writes with cache:    " : "  writes without cache: ") << seconds[cached] * 1e9 / operations << " ns per operation";
+        if (cached) {
+            VectorTree::CacheStats stats = tree.GetCacheStats();
+            cout << ", " << stats.latestHits << " + " << stats.historyHits << " hits, " << stats.misses << " misses, "
+                 << stats.materialized << " built";
+        }
+        cout << endl;
+    }
+    cout << "  " << (checksums[0] == checksums[1] ? "same sums" : "DIFFERENT SUMS")
+         << (seconds[1] <= seconds[0] * 1.25 ? "" : ", the cache is SLOWER") << endl; // The times change by ~10% from run to run
+}
+
+// Workload of the shared suite: n values appended together, then the queries are GetSum on the newest
+// version and the updates are set and add, every one a new version that keeps the older ones
+void suiteWorkload(const Workload &workload) {
+    int n = (int)workload.size;
+    KeyGenerator values(workload.distribution, n, workload.seed());
+    vector <int> block(n);
+    for (int &value : block) value = (int)values.below(100);
+    BenchmarkRun run("vector_tree", workload);
+
+    run.startBuild();
+    VectorTree tree;
+    tree.append(block);
+    run.endBuild(n);
+
+    bool point = false;
+    run.run(n, [&](bool read, uint64_t key, uint64_t other) -> long long {
+        int start = (int)min(key, other), end = (int)max(key, other);
+        if (read) return tree.GetSum(tree.GetVersion() - 1, start, end);
+        point = !point; // Half of the updates set an element, the other half add to a range
+        if (point) tree.set((int)key, (int)(other % 100));
+        else tree.add(start, end, key & 1 ? 1 : -1);
+        return 0;
+    });
+}
+
+// Replay a trace on a VectorTree, with or without the cache of the prefix sums
+bool replay(const string &path, bool cached) {
+    VectorTree tree;
+    if (cached) tree.EnableCache();
+    vector <int> values;
+    return replayTrace(path, cached ? "vector_cache" : "vector", [&](const TraceRecord &record) -> long long {
+        const int64_t *arguments = record.arguments;
+        switch (record.operation) {
+            case TRACE_BLOCK: TraceReader::values(record, values); tree.append(values); return 0;
+            case TRACE_APPEND: tree.insert((int)arguments[0]); return 0;
+            case TRACE_SET: tree.set((int)arguments[0], (int)arguments[1]); return 0;
+            case TRACE_UPDATE: tree.add((int)arguments[0], (int)arguments[1], (int)arguments[2]); return 0;
+            case TRACE_SUM: return tree.GetSum(tree.GetVersion() - 1, (int)arguments[0], (int)arguments[1]);
+            case TRACE_VERSION_SUM: return tree.GetSum((int)arguments[0], (int)arguments[1], (int)arguments[2]);
+            default: throw unsupported(record);
+        }
+    });
+}
+
 /*
     We can add new features to the VectorTree class, such as:
     - Support for removing values from the tree.
-    - Support for updating values in the tree. Lazy updates can be implemented to avoid recalculating the entire tree.
     - Support for querying the minimum or maximum value in a specified range.
     - Support for more complex queries, such as finding the k-th smallest or largest value in a specified range.
     - Support for multi-threaded access to the tree, allowing concurrent insertions and queries.
@@ -216,7 +1116,55 @@ class VectorTree {
     We can implement all these features like in every other tree data structure.
 */
 
-int main() {
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        // ./Vector_tree bench [n]
+        benchmarkVector(argc > 2 ? stoi(argv[2]) : 1000000);
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "append") {
+        // ./Vector_tree append [n] [block]
+        benchmarkAppend(argc > 2 ? stoi(argv[2]) : 10000000, argc > 3 ? stoi(argv[3]) : 10000);
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "update") {
+        // ./Vector_tree update [n] [updates]
+        benchmarkUpdates(argc > 2 ? stoi(argv[2]) : 1000000, argc > 3 ? stoi(argv[3]) : 1000000);
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "persist") {
+        // ./Vector_tree persist [n] [versions] [path]
+        benchmarkPersistence(argc > 2 ? stoi(argv[2]) : 10000000, argc > 3 ? stoi(argv[3]) : 100000,
+                             argc > 4 ? argv[4] : "vector_tree");
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "cache") {
+        // ./Vector_tree cache [n] [rounds]
+        int n = argc > 2 ? stoi(argv[2]) : 1000000;
+        cout << "n = " << n << endl;
+        benchmarkCache(n, argc > 3 ? stoi(argv[3]) : 1000);
+        benchmarkCacheWrites(n, 200000);
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "suite") {
+        // ./Vector_tree suite [sizes...], one JSON line for every workload
+        return runSuite("vector_tree", suiteSizes(argc, argv, 2), suiteWorkload) ? 0 : 1;
+    }
+
+    if (argc > 2 && string(argv[1]) == "replay") {
+        // ./Vector_tree replay <trace> [vector | vector_cache], by default both
+        string backend = argc > 3 ? argv[3] : "";
+        bool passed = true;
+        if (backend.empty() || backend == "vector") passed = replay(argv[2], false) && passed;
+        if (backend.empty() || backend == "vector_cache") passed = replay(argv[2], true) && passed;
+        return passed ? 0 : 1;
+    }
+
     cout << "Vector Tree Example" << endl;
     VectorTree tree;
     vector<int> values = {1, 2, 3, 4, 5};
@@ -237,5 +1185,13 @@ int main() {
     cout << "Sum from index " << start << " to " << end << ": " 
          << tree.GetSum(tree.GetVersion() - 1, start, end) << endl;
 
+    tree.set(1, 10); // New version with 10 at index 1
+    tree.add(0, 4, 1); // New version with 1 added to every value
+    cout << "Sum from index " << start << " to " << end << " after set and add: "
+         << tree.GetSum(tree.GetVersion() - 1, start, end) << endl; // Should output 17 (2 + 11 + 4)
+    cout << "Value at index 1 before the updates: " << tree.getValue(1, tree.GetVersion() - 3) << endl; // Should output 2
+
+    TREE_STATS_DUMP(cout); // Counters of the example, only with -DTREE_STATS
+
     return 0;
 }
\ No newline at end of file